@@ -0,0 +1,232 @@
+/**
+ *  \file chunkRing.c
+ *
+ *  \brief Problem name: Frequency of word lengths and the number of vowels.
+ *
+ *  Implements the bounded ring of chunks shared by the reader thread of the dispatcher, which fills it, and the
+ *  thread that sends the chunks to the workers. Chunks are taken in the order they were published, but are given back
+ *  in any order, as the workers finish them: the ready entries form a ring of positions, and the free entries a stack.
+ *
+ *  \author Rafael Direito - June 2020
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "chunkRing.h"
+
+/** \brief Occupancy of the ring so far. */
+RingStats ring_stats;
+
+/** \brief entries of the ring. */
+static RingEntry *entries;
+
+/** \brief number of entries of the ring. */
+static int ring_capacity;
+
+/** \brief positions of the ready entries, oldest first, starting at ready_first. */
+static int *ready;
+
+/** \brief position of the oldest ready entry in ready. */
+static int ready_first;
+
+/** \brief number of ready entries. */
+static int num_ready;
+
+/** \brief positions of the free entries. */
+static int *free_entries;
+
+/** \brief number of free entries. */
+static int num_free;
+
+/** \brief flag that indicates that the chunk buffers were allocated by the ring, and are freed with it. */
+static int owns_buffers;
+
+/** \brief flag that indicates that the reader will not publish more entries. */
+static int ring_closed;
+
+/** \brief lock of the ring. */
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** \brief signaled when an entry becomes ready, or the ring is closed. */
+static pthread_cond_t ready_cond = PTHREAD_COND_INITIALIZER;
+
+/** \brief signaled when an entry becomes free. */
+static pthread_cond_t free_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * \brief Create the ring, with the chunk buffers in the given memory or, if none is given, allocated by the ring.
+ *
+ * @param capacity number of entries
+ * @param bufferSize number of bytes of the chunk buffer of each entry, 0 for entries without one
+ * @param buffers memory of capacity chunk buffers, one after the other, or NULL
+ * @return 1 if the ring was created, 0 otherwise.
+ */
+static int create_ring(int capacity, int bufferSize, unsigned char *buffers) {
+    entries = calloc(capacity, sizeof(RingEntry));
+    ready = malloc(capacity * sizeof(int));
+    free_entries = malloc(capacity * sizeof(int));
+    if (entries == NULL || ready == NULL || free_entries == NULL)
+        return 0;
+
+    ring_capacity = capacity;
+    owns_buffers = buffers == NULL;
+    for (int i = 0; i < capacity; i++) {
+        entries[i].index = i;
+        if (buffers != NULL)
+            entries[i].info.chars_read = buffers + (size_t) i * bufferSize;
+        else if (bufferSize > 0 && (entries[i].info.chars_read = malloc(bufferSize)) == NULL)
+            return 0;
+        free_entries[i] = i;
+    }
+
+    ready_first = 0;
+    num_ready = 0;
+    num_free = capacity;
+    ring_closed = 0;
+    return 1;
+}
+
+/**
+ * \brief Create the ring.
+ *
+ * @param capacity number of entries
+ * @param bufferSize number of bytes of the chunk buffer of each entry, 0 for entries without one
+ * @return 1 if the ring was created, 0 otherwise.
+ */
+int ring_init(int capacity, int bufferSize) {
+    return create_ring(capacity, bufferSize, NULL);
+}
+
+/**
+ * \brief Create the ring, with the chunk buffers in memory of the caller, such as memory shared with other processes.
+ *
+ * The chunk buffer of the entry at position i starts i * bufferSize bytes into the memory, which is not freed with
+ * the ring.
+ *
+ * @param capacity number of entries
+ * @param bufferSize number of bytes of the chunk buffer of each entry
+ * @param buffers memory of capacity chunk buffers, one after the other
+ * @return 1 if the ring was created, 0 otherwise.
+ */
+int ring_init_shared(int capacity, int bufferSize, unsigned char *buffers) {
+    return create_ring(capacity, bufferSize, buffers);
+}
+
+/**
+ * \brief Free the ring.
+ */
+void ring_destroy() {
+    for (int i = 0; i < ring_capacity && owns_buffers; i++)
+        free(entries[i].info.chars_read);
+    free(entries);
+    free(ready);
+    free(free_entries);
+}
+
+/**
+ * \brief Get a free entry, to be filled by the reader, waiting for one if needed.
+ *
+ * @return the entry.
+ */
+RingEntry *ring_reserve() {
+    RingEntry *entry;
+
+    pthread_mutex_lock(&ring_lock);
+    if (num_free == 0)
+        ring_stats.num_full++;
+    while (num_free == 0)
+        pthread_cond_wait(&free_cond, &ring_lock);
+    entry = &entries[free_entries[--num_free]];
+    pthread_mutex_unlock(&ring_lock);
+
+    return entry;
+}
+
+/**
+ * \brief Make an entry filled by the reader ready to be sent.
+ *
+ * @param entry entry returned by ring_reserve
+ */
+void ring_publish(RingEntry *entry) {
+    pthread_mutex_lock(&ring_lock);
+    ready[(ready_first + num_ready++) % ring_capacity] = entry->index;
+    pthread_cond_signal(&ready_cond);
+    pthread_mutex_unlock(&ring_lock);
+}
+
+/**
+ * \brief Tell the sender that no more chunks will be published.
+ */
+void ring_close() {
+    pthread_mutex_lock(&ring_lock);
+    ring_closed = 1;
+    pthread_cond_signal(&ready_cond);
+    pthread_mutex_unlock(&ring_lock);
+}
+
+/**
+ * \brief Take the oldest ready entry, to be sent, waiting for the reader if needed.
+ *
+ * @return the entry, or NULL if the ring is closed and no entry is ready.
+ */
+RingEntry *ring_take() {
+    RingEntry *entry = NULL;
+
+    pthread_mutex_lock(&ring_lock);
+    ring_stats.sum_ready += num_ready;
+    if (num_ready > ring_stats.max_ready)
+        ring_stats.max_ready = num_ready;
+    if (num_ready == 0 && !ring_closed)
+        ring_stats.num_empty++;
+
+    while (num_ready == 0 && !ring_closed)
+        pthread_cond_wait(&ready_cond, &ring_lock);
+
+    if (num_ready > 0) {
+        entry = &entries[ready[ready_first]];
+        ready_first = (ready_first + 1) % ring_capacity;
+        num_ready--;
+        ring_stats.num_taken++;
+    }
+    pthread_mutex_unlock(&ring_lock);
+
+    return entry;
+}
+
+/**
+ * \brief Take the oldest ready entry, without waiting for the reader.
+ *
+ * An entry taken counts in the statistics of the ring as any other; a try that finds none does not.
+ *
+ * @return the entry, or NULL if no entry is ready.
+ */
+RingEntry *ring_try_take() {
+    RingEntry *entry = NULL;
+
+    pthread_mutex_lock(&ring_lock);
+    if (num_ready > 0) {
+        ring_stats.sum_ready += num_ready;
+        if (num_ready > ring_stats.max_ready)
+            ring_stats.max_ready = num_ready;
+
+        entry = &entries[ready[ready_first]];
+        ready_first = (ready_first + 1) % ring_capacity;
+        num_ready--;
+        ring_stats.num_taken++;
+    }
+    pthread_mutex_unlock(&ring_lock);
+
+    return entry;
+}
+
+/**
+ * \brief Give an entry back to the reader, once its chunk was sent.
+ *
+ * @param entry entry returned by ring_take, or by ring_reserve if it was not published
+ */
+void ring_release(RingEntry *entry) {
+    pthread_mutex_lock(&ring_lock);
+    free_entries[num_free++] = entry->index;
+    pthread_cond_signal(&free_cond);
+    pthread_mutex_unlock(&ring_lock);
+}
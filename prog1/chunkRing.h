@@ -0,0 +1,62 @@
+/**
+ *  \file chunkRing.h (header file)
+ *
+ *  \brief Problem name: Frequency of word lengths and the number of vowels.
+ *
+ *  Chunk ring header file: bounded queue of the chunks read ahead by the reader thread of the dispatcher
+ *
+ *  \author Rafael Direito - June 2020
+ */
+
+#include "controlInfo.h"
+
+#ifndef CHUNKRING_H_
+#define CHUNKRING_H_
+
+/** \brief Entry of the ring: a chunk ready to be sent, or being sent. */
+typedef struct {
+    int index;                      /* position of the entry in the ring */
+    ControlInfo info;               /* description of the chunk, with its own chunk buffer */
+    const unsigned char *chunk;     /* start of the chunk, in the chunk buffer or in a memory mapping */
+} RingEntry;
+
+/** \brief Occupancy of the ring, seen by the sender each time it takes a chunk. */
+typedef struct {
+    long num_taken;                 /* chunks taken, to be sent or counted by the dispatcher itself */
+    long sum_ready;                 /* chunks that were ready, summed over the takes */
+    int max_ready;                  /* most chunks that were ready at a take */
+    long num_empty;                 /* takes that waited for the reader, as no chunk was ready */
+    long num_full;                  /* times the reader waited for the sender, as every entry was in use */
+} RingStats;
+
+/** \brief Occupancy of the ring so far. */
+extern RingStats ring_stats;
+
+/** \brief Create the ring. */
+extern int ring_init(int capacity, int bufferSize);
+
+/** \brief Create the ring, with the chunk buffers in memory of the caller. */
+extern int ring_init_shared(int capacity, int bufferSize, unsigned char *buffers);
+
+/** \brief Free the ring. */
+extern void ring_destroy();
+
+/** \brief Get a free entry, to be filled by the reader. */
+extern RingEntry *ring_reserve();
+
+/** \brief Make an entry filled by the reader ready to be sent. */
+extern void ring_publish(RingEntry *entry);
+
+/** \brief Tell the sender that no more chunks will be published. */
+extern void ring_close();
+
+/** \brief Take the oldest ready entry, to be sent. */
+extern RingEntry *ring_take();
+
+/** \brief Take the oldest ready entry, without waiting for the reader. */
+extern RingEntry *ring_try_take();
+
+/** \brief Give an entry back to the reader, once its chunk was sent. */
+extern void ring_release(RingEntry *entry);
+
+#endif
@@ -0,0 +1,343 @@
+/**
+ *  \file compressedInput.c
+ *
+ *  \brief Problem: Frequency of word lengths and the number of vowels
+ *
+ *  Implements the reading of compressed input files, gzip or zstd, told by their first bytes, without decompressing
+ *  them to disk first.
+ *
+ *  A compressed file read by the dispatcher is opened as a stream of its decompressed bytes, through fopencookie, so
+ *  that it is cut in chunks as any other stream. A zstd file whose frames all record their decompressed size can also
+ *  be read at any offset by the workers: its frames are indexed, and a byte range is decompressed from the start of
+ *  the frame it begins in, so that the frames cut into separate ranges are decompressed by different workers at once.
+ *
+ *  \author Rafael Direito - June 2020
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <zlib.h>
+#include <zstd.h>
+#include "compressedInput.h"
+
+/** \brief number of bytes decompressed at a time, and dropped, before the offset of a read in a frame. */
+#define DISCARD_SIZE        (16 * 1024)
+
+/** \brief Stream of the decompressed bytes of a zstd file. */
+typedef struct {
+    FILE *fp;                       /* compressed file */
+    ZSTD_DCtx *context;             /* context of the decompression */
+    unsigned char *input;           /* buffer of the compressed bytes */
+    size_t input_size;              /* number of bytes of the buffer */
+    ZSTD_inBuffer in;               /* compressed bytes read and not decompressed yet */
+    size_t remaining;               /* result of the last decompression that made progress, 0 between frames */
+    int ended;                      /* flag that indicates that the whole file was read */
+} ZstdStream;
+
+/**
+ * \brief Tell the compression of a file from its first bytes: the magic number of gzip, or the one of a zstd frame or
+ * of a skippable frame.
+ *
+ * Only regular files are looked at, so that no byte of a pipe is lost.
+ *
+ * @param filename name of the file
+ * @return COMPRESSION_GZIP, COMPRESSION_ZSTD, or COMPRESSION_NONE for any other file.
+ */
+int input_compression(const char *filename) {
+    unsigned char magic[4];
+    struct stat file_stat;
+    FILE *fp;
+    size_t n;
+
+    if (stat(filename, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) || (fp = fopen(filename, "rb")) == NULL)
+        return COMPRESSION_NONE;
+    n = fread(magic, 1, sizeof magic, fp);
+    fclose(fp);
+
+    if (n >= 2 && magic[0] == 0x1F && magic[1] == 0x8B)
+        return COMPRESSION_GZIP;
+    if (n == 4 && ((magic[0] == 0x28 && magic[1] == 0xB5 && magic[2] == 0x2F && magic[3] == 0xFD)
+                   || ((magic[0] & 0xF0) == 0x50 && magic[1] == 0x2A && magic[2] == 0x4D && magic[3] == 0x18)))
+        return COMPRESSION_ZSTD;
+    return COMPRESSION_NONE;
+}
+
+/**
+ * \brief Read decompressed bytes of a gzip file, for fopencookie.
+ *
+ * A file that ends in the middle of a member is an error.
+ */
+static ssize_t read_gzip(void *cookie, char *buffer, size_t size) {
+    int n = gzread((gzFile) cookie, buffer, size > INT_MAX ? INT_MAX : (unsigned int) size);
+    int error;
+
+    if (n == 0) {
+        gzerror((gzFile) cookie, &error);
+        if (error != Z_OK)
+            return -1;
+    }
+    return n;
+}
+
+/**
+ * \brief Close a gzip file, for fopencookie.
+ */
+static int close_gzip(void *cookie) {
+    return gzclose((gzFile) cookie) == Z_OK ? 0 : EOF;
+}
+
+/**
+ * \brief Read decompressed bytes of a zstd file, for fopencookie.
+ *
+ * The frames follow one another in the stream. A file that ends in the middle of a frame is an error.
+ */
+static ssize_t read_zstd(void *cookie, char *buffer, size_t size) {
+    ZstdStream *stream = cookie;
+    ZSTD_outBuffer out = {buffer, size, 0};
+    size_t before, consumed, result;
+
+    while (out.pos < out.size) {
+        if (stream->in.pos == stream->in.size && !stream->ended) {
+            stream->in.size = fread(stream->input, 1, stream->input_size, stream->fp);
+            stream->in.pos = 0;
+            stream->ended = stream->in.size == 0;
+        }
+
+        // once the file ended, only the bytes the context still holds come out
+        before = out.pos;
+        consumed = stream->in.pos;
+        result = ZSTD_decompressStream(stream->context, &out, &stream->in);
+        if (ZSTD_isError(result))
+            return -1;
+        if (out.pos == before && stream->in.pos == consumed) {
+            if (stream->ended)
+                break;
+            continue;
+        }
+        stream->remaining = result;
+    }
+
+    if (out.pos == 0 && (ferror(stream->fp) || stream->remaining != 0))
+        return -1;
+    return (ssize_t) out.pos;
+}
+
+/**
+ * \brief Close a zstd file, for fopencookie.
+ */
+static int close_zstd(void *cookie) {
+    ZstdStream *stream = cookie;
+    int result = fclose(stream->fp);
+
+    ZSTD_freeDCtx(stream->context);
+    free(stream->input);
+    free(stream);
+    return result;
+}
+
+/**
+ * \brief Open a zstd file as a stream of its decompressed bytes.
+ *
+ * @param filename name of the file
+ * @return the stream, or NULL if the file cannot be opened.
+ */
+static FILE *open_zstd(const char *filename) {
+    cookie_io_functions_t functions = {read_zstd, NULL, NULL, close_zstd};
+    ZstdStream *stream = calloc(1, sizeof(ZstdStream));
+    FILE *file;
+
+    if (stream == NULL)
+        return NULL;
+    stream->input_size = ZSTD_DStreamInSize();
+    stream->input = malloc(stream->input_size);
+    stream->context = ZSTD_createDCtx();
+    stream->fp = fopen(filename, "rb");
+    stream->in.src = stream->input;
+
+    if (stream->input != NULL && stream->context != NULL && stream->fp != NULL
+        && (file = fopencookie(stream, "r", functions)) != NULL)
+        return file;
+
+    if (stream->fp != NULL)
+        fclose(stream->fp);
+    ZSTD_freeDCtx(stream->context);
+    free(stream->input);
+    free(stream);
+    return NULL;
+}
+
+/**
+ * \brief Open a compressed file as a stream of its decompressed bytes, read as any other stream.
+ *
+ * A read error of the stream tells that the file could not be decompressed.
+ *
+ * @param filename name of the file
+ * @param compression COMPRESSION_GZIP or COMPRESSION_ZSTD
+ * @return the stream, or NULL if the file cannot be opened.
+ */
+FILE *open_decompressed(const char *filename, int compression) {
+    cookie_io_functions_t functions = {read_gzip, NULL, NULL, close_gzip};
+    gzFile gzip;
+    FILE *file;
+
+    if (compression == COMPRESSION_ZSTD)
+        return open_zstd(filename);
+
+    gzip = gzopen(filename, "rb");
+    if (gzip == NULL)
+        return NULL;
+    gzbuffer(gzip, 128 * 1024);
+
+    file = fopencookie(gzip, "r", functions);
+    if (file == NULL)
+        gzclose(gzip);
+    return file;
+}
+
+/**
+ * \brief Index the frames of a zstd file, which must all record their decompressed size.
+ *
+ * The file is memory mapped, and each frame is found by walking the headers of its blocks, without decompressing it.
+ *
+ * @param filename name of the file
+ * @param index index where the frames are stored, left empty if the file cannot be indexed
+ * @return 1 if the file was indexed, 0 otherwise.
+ */
+int frame_index_open(const char *filename, FrameIndex *index) {
+    struct stat file_stat;
+    int fd = open(filename, O_RDONLY);
+    int capacity = 0;
+    long position = 0, offset = 0;
+
+    memset(index, 0, sizeof *index);
+    if (fd < 0)
+        return 0;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    index->map_size = file_stat.st_size;
+    index->map = mmap(NULL, index->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (index->map == MAP_FAILED) {
+        index->map = NULL;
+        return 0;
+    }
+
+    while (true) {
+        size_t compressedSize = 0;
+        unsigned long long size = 0;
+
+        if (index->num_frames + 1 >= capacity) {
+            long *compressedOffsets, *offsets;
+
+            capacity = capacity > 0 ? 2 * capacity : 64;
+            compressedOffsets = realloc(index->compressed_offsets, capacity * sizeof(long));
+            if (compressedOffsets != NULL)
+                index->compressed_offsets = compressedOffsets;
+            offsets = realloc(index->offsets, capacity * sizeof(long));
+            if (offsets != NULL)
+                index->offsets = offsets;
+            if (compressedOffsets == NULL || offsets == NULL)
+                break;
+        }
+
+        index->compressed_offsets[index->num_frames] = position;
+        index->offsets[index->num_frames] = offset;
+        if (position == (long) index->map_size)
+            return 1;
+
+        compressedSize = ZSTD_findFrameCompressedSize(index->map + position, index->map_size - position);
+        size = ZSTD_getFrameContentSize(index->map + position, index->map_size - position);
+        if (ZSTD_isError(compressedSize) || size == ZSTD_CONTENTSIZE_UNKNOWN || size == ZSTD_CONTENTSIZE_ERROR)
+            break;
+
+        index->num_frames++;
+        position += (long) compressedSize;
+        offset += (long) size;
+    }
+
+    frame_index_close(index);
+    return 0;
+}
+
+/**
+ * \brief Read decompressed bytes of an indexed zstd file, at a given offset.
+ *
+ * Each frame read is decompressed from its start, the bytes before the offset being dropped, and the next frames
+ * follow until enough bytes are read.
+ *
+ * @param index index of the frames of the file
+ * @param offset offset of the first byte to read, in the decompressed file
+ * @param buffer buffer where the bytes are stored
+ * @param length number of bytes to read
+ * @return number of bytes read, less than length only at the end of the file, or -1 if the file could not be
+ * decompressed.
+ */
+long frame_index_read(FrameIndex *index, long offset, unsigned char *buffer, size_t length) {
+    unsigned char discard[DISCARD_SIZE];
+    size_t done = 0;
+    int low = 0, high = index->num_frames - 1, middle;
+
+    if (index->num_frames == 0 || offset >= index->offsets[index->num_frames])
+        return 0;
+    if (index->context == NULL && (index->context = ZSTD_createDCtx()) == NULL)
+        return -1;
+
+    // the last frame starting at the offset or before it
+    while (low < high) {
+        middle = (low + high + 1) / 2;
+        if (index->offsets[middle] <= offset)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+
+    for (int k = low; k < index->num_frames && done < length; k++) {
+        long skip = offset + (long) done - index->offsets[k];
+        ZSTD_inBuffer in = {index->map + index->compressed_offsets[k],
+                            index->compressed_offsets[k + 1] - index->compressed_offsets[k], 0};
+        size_t remaining = 1;
+
+        ZSTD_DCtx_reset(index->context, ZSTD_reset_session_only);
+        while (remaining != 0 && done < length) {
+            ZSTD_outBuffer out = skip > 0 ? (ZSTD_outBuffer) {discard, skip < DISCARD_SIZE ? skip : DISCARD_SIZE, 0}
+                                          : (ZSTD_outBuffer) {buffer + done, length - done, 0};
+
+            remaining = ZSTD_decompressStream(index->context, &out, &in);
+            if (ZSTD_isError(remaining) || (remaining != 0 && out.pos == 0 && in.pos == in.size))
+                return -1;
+            if (skip > 0)
+                skip -= (long) out.pos;
+            else
+                done += out.pos;
+        }
+    }
+
+    return (long) done;
+}
+
+/**
+ * \brief Free the index of the frames of a zstd file, unmapping the file, which is left empty.
+ *
+ * @param index index of the frames of the file
+ */
+void frame_index_close(FrameIndex *index) {
+    if (index->map != NULL)
+        munmap(index->map, index->map_size);
+    free(index->compressed_offsets);
+    free(index->offsets);
+    ZSTD_freeDCtx(index->context);
+    memset(index, 0, sizeof *index);
+}
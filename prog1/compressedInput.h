@@ -0,0 +1,48 @@
+/**
+ *  \file compressedInput.h (header file)
+ *
+ *  \brief Problem: Frequency of word lengths and the number of vowels
+ *
+ *  Compressed input header file: gzip and zstd files decompressed on the fly
+ *
+ *  \author Rafael Direito - June 2020
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+
+#ifndef COMPRESSEDINPUT_H_
+#define COMPRESSEDINPUT_H_
+
+/* Compression of an input file, told by its first bytes */
+#define COMPRESSION_NONE    0
+#define COMPRESSION_GZIP    1
+#define COMPRESSION_ZSTD    2
+
+/** \brief Frames of a zstd file that all record their decompressed size, so that any of them can be decompressed on
+ * its own. */
+typedef struct {
+    unsigned char *map;             /* memory mapping of the compressed file, NULL if the file is not indexed */
+    size_t map_size;                /* size of the compressed file */
+    int num_frames;                 /* number of frames */
+    long *compressed_offsets;       /* offset of each frame in the compressed file, and its size after the last one */
+    long *offsets;                  /* offset of each frame in the decompressed file, and its size after the last one */
+    void *context;                  /* context of the decompression, created on the first read */
+} FrameIndex;
+
+/** \brief Tell the compression of a file from its first bytes. */
+extern int input_compression(const char *filename);
+
+/** \brief Open a compressed file as a stream of its decompressed bytes. */
+extern FILE *open_decompressed(const char *filename, int compression);
+
+/** \brief Index the frames of a zstd file. */
+extern int frame_index_open(const char *filename, FrameIndex *index);
+
+/** \brief Read decompressed bytes of an indexed zstd file, at a given offset. */
+extern long frame_index_read(FrameIndex *index, long offset, unsigned char *buffer, size_t length);
+
+/** \brief Free the index of the frames of a zstd file, which is left empty. */
+extern void frame_index_close(FrameIndex *index);
+
+#endif
@@ -8,19 +8,90 @@
  *  \author Rafael Direito - June 2020
  */
 
+#include <stddef.h>
 #include "probConst.h"
 
 #ifndef CONTROLINFO_H_
 #define CONTROLINFO_H_
 
+/** \brief Number of words of a length and number of vowels, for the words longer than WORD_LENGTH. */
+typedef struct {
+    int word_length;
+    int num_vowels;
+    int count;                      /* 0 for an entry not in use */
+} LongWordCount;
+
+/** \brief number of text metrics that can be computed with the word counts, see textMetrics.h. */
+#define NUM_METRICS 4
+
+/** \brief Count of a key of a text metric: a letter, a pair of letters, or a number of words or consonants. */
+typedef struct {
+    long long key;
+    long long count;                /* 0 for an entry not in use */
+} MetricCount;
+
+/** \brief Mergeable accumulator of a text metric: an open addressing table of the counts of its keys. */
+typedef struct {
+    MetricCount *entries;           /* NULL while there are none */
+    int num_entries;                /* number of entries in use */
+    int size;                       /* number of entries, a power of two */
+} MetricTable;
+
+/** \brief Number of times a word was found, with its text kept in the arena of its vocabulary. */
+typedef struct {
+    unsigned long long hash;        /* hash of the text, which also tells the process owning the word */
+    const char *text;               /* text of the word, not terminated */
+    int length;                     /* number of bytes of the text */
+    long long count;                /* 0 for an entry not in use */
+} VocabularyEntry;
+
+/** \brief Frequency of every word: an open addressing table, with the texts of the words in an arena of blocks. */
+typedef struct {
+    VocabularyEntry *entries;       /* NULL while there are none */
+    int num_entries;                /* number of entries in use */
+    int size;                       /* number of entries, a power of two */
+    char *arena;                    /* block the texts are being added to, linked to the previous block */
+    size_t arena_used;              /* bytes of the block in use */
+} Vocabulary;
+
+/** \brief Counts of the words: dense histograms up to WORD_LENGTH, and a hash table of the rarer, longer words. */
 typedef struct {
-    int fileIndex;
-    int n_chars_read;
     int num_words_read;
     int max_num_vowels;
     int max_word_length;
-    unsigned char chars_read[WORD_LENGTH * K];
     int word_lengths[WORD_LENGTH];
-    int word_vowels[WORD_LENGTH][WORD_LENGTH];
+    int word_vowels[WORD_LENGTH + 1][WORD_LENGTH];
+    LongWordCount *long_words;      /* open addressing table of the longer words, NULL while there are none */
+    int num_long_words;             /* number of entries in use */
+    int long_words_size;            /* number of entries, a power of two */
+    MetricTable metrics[NUM_METRICS];   /* accumulators of the selected text metrics, empty for the others */
+    Vocabulary vocabulary;          /* frequency of every word, while it is counted, never sent with the counts */
+    struct WordSketch *sketch;      /* fixed size sketches of the words, see wordSketch.h, NULL while there are none */
+    int read_failed;                /* flag that indicates that part of the file could not be read, so the counts of
+                                       the file are partial */
+} WordCounts;
+
+typedef struct {
+    int fileIndex;
+    int n_chars_read;
+    long offset;
+    int num_parts;
+    unsigned char *chars_read;
+    WordCounts counts;
 } ControlInfo;
+
+/** \brief size of the fields of ControlInfo that describe the chunk, sent ahead of the chunk itself. */
+#define CONTROL_INFO_HEADER_SIZE offsetof(ControlInfo, chars_read)
+
+/** \brief File of a batch: a small file packed whole, with other small files, into a single chunk. */
+typedef struct {
+    int fileIndex;
+    int length;
+} BatchPart;
+
+/** \brief size of the table at the start of a batch of n files: their number, then their parts, in order. */
+#define BATCH_TABLE_SIZE(n) (sizeof(int) + (n) * sizeof(BatchPart))
+
+/** \brief size of the chunk buffers, with room for a chunk of chunkSize bytes or a batch with the largest table. */
+#define CHUNK_BUFFER_SIZE(chunkSize) ((chunkSize) + BATCH_TABLE_SIZE(MAX_BATCH_FILES))
 #endif
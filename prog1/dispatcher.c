@@ -8,49 +8,118 @@
  *  \author Rafael Direito - June 2020
  */
 
+#include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
+#include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "probConst.h"
 #include "controlInfo.h"
+#include "wordstats.h"
+#include "textMetrics.h"
+#include "wordSketch.h"
+#include "sampling.h"
+#include "compressedInput.h"
 
-/** \brief pointer which contains the file information. */
-FILE *fp;
+/** \brief Reading state of a file, kept apart for each file so that chunks of several files can be cut at once. */
+typedef struct {
+    int fileIndex;                  /* index of the file in the command */
+    long size;                      /* size of the file, -1 if unknown until it is read */
+    int opened;                     /* flag that indicates that chunks are being cut from the file */
+    int mapped;                     /* flag that indicates if the file is memory mapped (even if empty), not read by fp */
+    FILE *fp;                       /* stream of the file, when it is not memory mapped */
+    unsigned char *map;             /* memory mapping of the file, NULL if it is empty or read through fp */
+    size_t map_offset;              /* offset of the next byte to be read from the memory mapping */
+    unsigned char *stream_buffer;   /* buffer where the file is staged when read through fp, with chunk_size bytes */
+    size_t stream_fill;             /* number of bytes in the stream buffer */
+    size_t stream_sent;             /* number of bytes at the start of the stream buffer that belong to the chunk sent last */
+    int stream_ended;               /* flag that indicates that the stream ended, or could not be read any further */
+    long range_offset;              /* offset of the next byte range, when the workers read the file themselves */
+    int compression;                /* compression of the file, read through a stream of its decompressed bytes */
+    FrameIndex frames;              /* frames of a zstd file, while the workers are handed its ranges */
+    int next_frame;                 /* frame the next byte range of an indexed zstd file starts in */
+} FileReader;
 
-/** \brief pointer that contains the all the filenames retrieved from the command arguments. */
-char **filenames;
+/** \brief reading state of each file. */
+FileReader *readers;
 
-/** \brief total number of filenames retrieved. */
-int num_files;
+/** \brief indexes of the files in the order they are opened, largest first. */
+int *file_order;
+
+/** \brief position in file_order of the next file to be opened. */
+int next_file = 0;
+
+/** \brief indexes of the files chunks are being cut from, in the order they were opened. */
+int open_files[MAX_OPEN_FILES];
+
+/** \brief number of files chunks are being cut from. */
+int num_open = 0;
+
+/** \brief position in open_files of the file the next chunk is cut from. */
+int current_open = 0;
+
+/** \brief largest number of files chunks are cut from at once. */
+int max_open_files = DEFAULT_OPEN_FILES;
+
+/** \brief memory mapping of each file, kept until all the chunks that point into it were sent. */
+unsigned char **file_maps;
+
+/** \brief size of the memory mapping of each file. */
+size_t *file_map_sizes;
+
+/** \brief number of chunks of each memory mapped file that were retrieved but not sent yet. */
+int *mapped_chunks;
 
-/** \brief pointer that saves the total number of words found in each file. */
-int *gbl_total_num_words;
+/** \brief flag that indicates, for each file, if it was closed by the reader of the chunks. */
+int *map_closed;
 
-/** \brief pointer that saves the highest numbers of vowels found in a word in each file. */
-int *gbl_max_num_vowels;
+/** \brief flag that indicates, for each file, if it could not be read whole, so that its counts are left out. */
+int *read_failed;
 
-/** \brief pointer that saves the sizes of the longest word found in each file. */
-int *gbl_max_word_length;
+/** \brief lock of the mappings, shared by the reader of the chunks and the sender. */
+pthread_mutex_t map_lock = PTHREAD_MUTEX_INITIALIZER;
 
-/** \brief pointer that saves the lengths of words found in each file. */
-int (*gbl_word_lengths)[WORD_LENGTH];
+/** \brief number of bytes of each chunk of work. */
+int chunk_size = DEFAULT_CHUNK_SIZE;
 
-/** \brief pointer that saves the number of vowels associated to the length of each word in each file. */
-int (*gbl_word_vowels)[WORD_LENGTH][WORD_LENGTH];
+/** \brief pointer that contains the all the filenames retrieved from the command arguments. */
+char **filenames;
+
+/** \brief total number of filenames retrieved. */
+int num_files;
 
-/** \brief index which represents the current opened file. */
-int files_idx = -1;
+/** \brief pointer that saves the counts of the words found in each file: the total number of words, the highest
+ * number of vowels and the size of the longest word, the lengths of the words and the number of vowels associated to
+ * each length. */
+WordCounts *gbl_counts;
 
-/** \brief flag that indicates if the current file was open. */
-int file_opened = 0;
 
-/** \brief flag that indicates if the current file was closed. */
-int file_closed = 1;
 
 
+/**
+ * \brief Order two files, largest first.
+ *
+ * Files of unknown size, such as pipes, come first, as they may be the largest; files of the same size are kept in
+ * the order of the command.
+ *
+ * @param a index of a file
+ * @param b index of another file
+ * @return a negative number if the file a comes first, a positive number otherwise.
+ */
+static int compare_file_sizes(const void *a, const void *b) {
+    int fa = *(const int *) a, fb = *(const int *) b;
+    long sa = readers[fa].size, sb = readers[fb].size;
 
+    if (sa != sb)
+        return sa < 0 ? -1 : sb < 0 ? 1 : sa > sb ? -1 : 1;
+    return fa - fb;
+}
 
 /**
  * Used by the dispatcher to present the filenames to be processed
@@ -58,103 +127,640 @@ int file_closed = 1;
  * @param nFiles number of files to be processed
  */
 void presentFileNames(char *inputFilenames[], unsigned int nFiles){
+    struct stat file_stat;
+
     // Store filenames
     filenames = inputFilenames;
 
     num_files = nFiles;
 
     // Allocate spaces
-    gbl_total_num_words = malloc(nFiles);
-    gbl_max_num_vowels = malloc(nFiles);
-    gbl_max_word_length = malloc(nFiles);
-    gbl_word_lengths = malloc(sizeof(int[WORD_LENGTH]) * (nFiles));
-    gbl_word_vowels = malloc(sizeof(int[WORD_LENGTH][WORD_LENGTH]) * (nFiles));
-
+    gbl_counts = calloc(nFiles, sizeof(WordCounts));
+    file_maps = calloc(nFiles, sizeof(unsigned char *));
+    file_map_sizes = calloc(nFiles, sizeof(size_t));
+    mapped_chunks = calloc(nFiles, sizeof(int));
+    map_closed = calloc(nFiles, sizeof(int));
+    read_failed = calloc(nFiles, sizeof(int));
+    readers = calloc(nFiles, sizeof(FileReader));
+    file_order = malloc(sizeof(int) * nFiles);
+
+    // compressed files are streams, whose size is unknown until they are decompressed
     for (int i = 0; i<nFiles; i++) {
-        gbl_total_num_words[i] = 0;
-        gbl_max_num_vowels[i] = 0;
-        gbl_max_word_length[i] = 0;
+        readers[i].fileIndex = i;
+        readers[i].size = stat(filenames[i], &file_stat) == 0 && S_ISREG(file_stat.st_mode) ? file_stat.st_size : -1;
+        readers[i].compression = readers[i].size > 0 ? input_compression(filenames[i]) : COMPRESSION_NONE;
+        if (readers[i].compression != COMPRESSION_NONE)
+            readers[i].size = -1;
+        file_order[i] = i;
     }
+
+    // the largest files are cut first, so that the last chunks handed out are small ones
+    qsort(file_order, nFiles, sizeof(int), compare_file_sizes);
+    next_file = 0;
+    num_open = 0;
+    current_open = 0;
+}
+
+/**
+ * \brief Set the number of bytes of each chunk of work.
+ *
+ * @param chunkSize number of bytes, from MIN_CHUNK_SIZE to MAX_CHUNK_SIZE
+ */
+void set_chunk_size(int chunkSize) {
+    chunk_size = chunkSize;
+}
+
+/**
+ * \brief Set the number of files chunks are cut from at once.
+ *
+ * @param openFiles number of files, from 1 to MAX_OPEN_FILES
+ */
+void set_open_files(int openFiles) {
+    max_open_files = openFiles;
+}
+
+/**
+ * \brief Parse a number of bytes, with an optional K, M or G suffix.
+ *
+ * @param text text to parse
+ * @return the number of bytes, or -1 if the text is not a valid chunk size.
+ */
+long parse_chunk_size(const char *text) {
+    char *end;
+    int shift = 0;
+    long size = strtol(text, &end, 10);
+
+    switch (toupper((unsigned char) *end)) {
+        case 'K': shift = 10; end++; break;
+        case 'M': shift = 20; end++; break;
+        case 'G': shift = 30; end++; break;
+    }
+
+    if (end == text || *end != '\0' || size <= 0 || size > (MAX_CHUNK_SIZE >> shift))
+        return -1;
+
+    size <<= shift;
+    return size < MIN_CHUNK_SIZE ? -1 : size;
 }
 
 /**
- * \brief Verify if there's a file remaining to be opened and, if exists, open it.
- * *
- * @return 1 if a file is opened, 0 otherwise.
+ * \brief Map a regular file in memory, to be read sequentially.
+ *
+ * @param reader reading state of the file
+ * @return 1 if the file was mapped, 0 if it must be read through a stream instead.
  */
-int file_available() {
-    int file_available = 1;
-    files_idx++;
+static int map_file(FileReader *reader) {
+    struct stat file_stat;
+    int fd = open(filenames[reader->fileIndex], O_RDONLY);
+
+    if (fd < 0)
+        return 0;
 
-    /* if there's still files to be read and there's no file opened, open the current file. */
-    if (files_idx < num_files) {
-        file_opened = 1;
-        file_closed = 0;
-        fp = fopen(filenames[files_idx], "r");
+    if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+        close(fd);
+        return 0;
+    }
 
-        if (fp == NULL) {
-            printf("ERROR: Unable to open the file: %s\n", filenames[files_idx]);
-            file_available = 0;
-            file_opened = 0;
+    reader->map = NULL;
+    reader->size = file_stat.st_size;
+    reader->map_offset = 0;
+
+    // empty files cannot be mapped, but there is nothing to read from them either
+    if (reader->size > 0) {
+        reader->map = mmap(NULL, reader->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (reader->map == MAP_FAILED) {
+            reader->map = NULL;
+            close(fd);
+            return 0;
         }
-        memset(gbl_word_lengths[files_idx], 0, sizeof gbl_word_lengths[files_idx]);
-        memset(gbl_word_vowels[files_idx], 0, sizeof gbl_word_vowels[files_idx]);
+        madvise(reader->map, reader->size, MADV_SEQUENTIAL);
     }
+
+    // the mapping stays valid after the file descriptor is closed
+    close(fd);
+    reader->mapped = 1;
+    file_maps[reader->fileIndex] = reader->map;
+    file_map_sizes[reader->fileIndex] = reader->size;
+    return 1;
+}
+
+/**
+ * \brief Open the next file to be processed, the largest of the ones left.
+ *
+ * A file that cannot be opened is reported and skipped.
+ *
+ * @return 1 if a file is opened, 0 if there are no files left.
+ */
+static int file_available() {
+    FileReader *reader;
+
+    while (next_file < num_files) {
+        reader = &readers[file_order[next_file++]];
+        reader->mapped = 0;
+
+        // regular files are memory mapped, anything else is read through a stream, decompressed on the fly, and the
+        // name - is the standard input
+        if (reader->compression != COMPRESSION_NONE || !map_file(reader)) {
+            if (strcmp(filenames[reader->fileIndex], STDIN_NAME) == 0)
+                reader->fp = stdin;
+            else
+                reader->fp = reader->compression != COMPRESSION_NONE
+                             ? open_decompressed(filenames[reader->fileIndex], reader->compression)
+                             : fopen(filenames[reader->fileIndex], "r");
+            reader->stream_fill = 0;
+            reader->stream_sent = 0;
+            reader->stream_ended = 0;
+            reader->stream_buffer = malloc(chunk_size);
+        }
+
+        if (!reader->mapped && (reader->fp == NULL || reader->stream_buffer == NULL)) {
+            if (reader->fp != NULL && reader->fp != stdin)
+                fclose(reader->fp);
+            free(reader->stream_buffer);
+            reader->stream_buffer = NULL;
+            printf("ERROR: Unable to open the file: %s\n", filenames[reader->fileIndex]);
+            read_failed[reader->fileIndex] = 1;
+            continue;
+        }
+
+        reader->opened = 1;
+        open_files[num_open++] = reader->fileIndex;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * \brief Unmap a file closed by the reader once none of its chunks is waiting to be sent, with map_lock held.
+ *
+ * @param fileIndex index of the file
+ */
+static void unmap_if_unused(int fileIndex) {
+    if (map_closed[fileIndex] && mapped_chunks[fileIndex] == 0 && file_maps[fileIndex] != NULL) {
+        munmap(file_maps[fileIndex], file_map_sizes[fileIndex]);
+        file_maps[fileIndex] = NULL;
+    }
+}
+
+/**
+ * \brief Close the file at a position of open_files, so that the next file can be opened.
+ *
+ * A memory mapped file is only unmapped once all its chunks were sent, as told by release_data. The standard input
+ * is left open.
+ *
+ * @param position position of the file in open_files
+ */
+static void close_file(int position) {
+    FileReader *reader = &readers[open_files[position]];
+
+    if (!reader->mapped) {
+        if (reader->fp != stdin)
+            fclose(reader->fp);
+        free(reader->stream_buffer);
+        reader->stream_buffer = NULL;
+    }
+    else {
+        pthread_mutex_lock(&map_lock);
+        map_closed[reader->fileIndex] = 1;
+        unmap_if_unused(reader->fileIndex);
+        pthread_mutex_unlock(&map_lock);
+    }
+    reader->opened = 0;
+
+    // the other files keep their turns
+    memmove(&open_files[position], &open_files[position + 1], (num_open - position - 1) * sizeof(int));
+    num_open--;
+}
+
+/**
+ * \brief Choose where a chunk ends, at the last word boundary that fits in a chunk.
+ *
+ * The chunk ends at a boundary found by wordstats_last_boundary, so that the words of the chunks are the words of the
+ * file. Only a word longer than a chunk is cut, where the chunk is full.
+ *
+ * @param data bytes available for the chunk, starting at the chunk
+ * @param available number of bytes available, a number smaller than chunk_size meaning the rest of the file
+ * @return number of bytes of the chunk.
+ */
+static int cut_chunk(const unsigned char *data, size_t available) {
+    size_t end;
+
+    if (available < chunk_size)
+        return (int) available;
+
+    end = wordstats_last_boundary(data, chunk_size);
+    return end != 0 ? (int) end : chunk_size;
+}
+
+/**
+ * \brief Retrieve a chunk from a memory mapped file, without copying it.
+ *
+ * The mapping must stay valid until the chunk is sent: it is counted until release_data is called for it.
+ *
+ * @param reader reading state of the file
+ * @param controlInfo structure where the offset and size of the chunk are stored
+ * @return pointer to the start of the chunk, inside the memory mapping.
+ */
+static const unsigned char *get_mapped_data(FileReader *reader, ControlInfo *controlInfo) {
+    const unsigned char *start = reader->map + reader->map_offset;
+
+    controlInfo->offset = reader->map_offset;
+    controlInfo->n_chars_read = cut_chunk(start, reader->size - reader->map_offset);
+    reader->map_offset += controlInfo->n_chars_read;
+
+    pthread_mutex_lock(&map_lock);
+    mapped_chunks[reader->fileIndex]++;
+    pthread_mutex_unlock(&map_lock);
+
+    return start;
+}
+
+/**
+ * \brief Read the bytes of a stream that are available, up to a number of them.
+ *
+ * A pipe or the standard input is read as its data arrives: a single read returns what was written to it so far,
+ * without waiting for the rest of the chunk. A decompressed stream, which has no descriptor, is read through stdio.
+ * The stream ends at the end of its data, or at a read error, which is reported, and which leaves the results of the
+ * file out.
+ *
+ * @param reader reading state of the file
+ * @param buffer where the bytes are read to
+ * @param length largest number of bytes to read
+ * @return number of bytes read.
+ */
+static size_t read_stream(FileReader *reader, unsigned char *buffer, size_t length) {
+    int fd = fileno(reader->fp);
+    ssize_t n;
+    int isError;
+
+    if (fd < 0) {
+        n = (ssize_t) fread(buffer, 1, length, reader->fp);
+        isError = ferror(reader->fp);
+        reader->stream_ended = isError || feof(reader->fp);
+    } else {
+        do
+            n = read(fd, buffer, length);
+        while (n < 0 && errno == EINTR);
+        isError = n < 0;
+        if (isError)
+            n = 0;
+        reader->stream_ended = n == 0;
+    }
+
+    // the file ends at an error, such as a compressed file cut short, and its partial counts are not printed
+    if (isError) {
+        printf("ERROR: Unable to read the whole file: %s\n", filenames[reader->fileIndex]);
+        read_failed[reader->fileIndex] = 1;
+    }
+    return (size_t) n;
+}
+
+/**
+ * \brief Retrieve a chunk from a file read through a stream.
+ *
+ * The bytes after the end of the chunk retrieved last are kept at the start of the stream buffer, and the buffer is
+ * filled from the file, with the bytes available, before the next chunk is cut. Until the stream ends, the chunk ends
+ * at the last word boundary read so far, even if it is not full, so that the chunks are handed out as the data
+ * arrives; a chunk without any boundary yet is empty, and waits for more data. The chunk is copied to the chunk
+ * buffer of controlInfo, so that it stays valid while the next ones are read.
+ *
+ * @param reader reading state of the file
+ * @param controlInfo structure where the size of the chunk is stored, and where the chunk is copied
+ * @return pointer to the start of the chunk, in the chunk buffer of controlInfo.
+ */
+static const unsigned char *get_stream_data(FileReader *reader, ControlInfo *controlInfo) {
+    memmove(reader->stream_buffer, reader->stream_buffer + reader->stream_sent, reader->stream_fill - reader->stream_sent);
+    reader->stream_fill -= reader->stream_sent;
+    if (!reader->stream_ended)
+        reader->stream_fill += read_stream(reader, reader->stream_buffer + reader->stream_fill,
+                                           chunk_size - reader->stream_fill);
+
+    if (reader->stream_ended || reader->stream_fill == chunk_size)
+        controlInfo->n_chars_read = cut_chunk(reader->stream_buffer, reader->stream_fill);
     else
-        file_available = 0;
-    return file_available;
+        controlInfo->n_chars_read = (int) wordstats_last_boundary(reader->stream_buffer, reader->stream_fill);
+    reader->stream_sent = controlInfo->n_chars_read;
+
+    memcpy(controlInfo->chars_read, reader->stream_buffer, controlInfo->n_chars_read);
+    return controlInfo->chars_read;
+}
+
+/**
+ * \brief Check if all the chunks of a file were retrieved.
+ *
+ * @param reader reading state of the file
+ * @return 1 if there is nothing left to be sent from the file, 0 otherwise.
+ */
+static int file_drained(FileReader *reader) {
+    if (reader->mapped)
+        return reader->map_offset == (size_t) reader->size;
+    return reader->stream_sent == reader->stream_fill && reader->stream_ended;
+}
+
+/**
+ * \brief Check if the next file to be opened is small enough to be packed whole into a batch.
+ *
+ * @return 1 if the next file is a regular file smaller than a chunk, 0 otherwise.
+ */
+static int small_file_next() {
+    return next_file < num_files && readers[file_order[next_file]].size >= 0
+           && readers[file_order[next_file]].size < chunk_size;
 }
 
 /**
- * \brief Close the current opened file and indicate that the next file can be opened.
+ * \brief Read a small file whole, without keeping it open.
+ *
+ * @param reader reading state of the file
+ * @param data where the file is read to, with room for the size of the file
+ * @return number of bytes read, or -1 if the file cannot be opened or read.
  */
-void close_file() {
-    if (!file_closed) {
-        fclose(fp);
-        file_opened = 0;
-        file_closed = 1;
+static long read_small_file(FileReader *reader, unsigned char *data) {
+    int fd = open(filenames[reader->fileIndex], O_RDONLY);
+    long length = 0;
+    ssize_t n = 0;
+
+    if (fd < 0)
+        return -1;
+
+    // a file that grew since it was sized is read up to its former size
+    while (length < reader->size) {
+        do
+            n = read(fd, data + length, reader->size - length);
+        while (n < 0 && errno == EINTR);
+        if (n <= 0)
+            break;
+        length += n;
     }
+
+    close(fd);
+    return n < 0 ? -1 : length;
 }
 
 /**
- * \brief Retrieve K tokens from the current open file.
+ * \brief Pack the next small files whole into a single chunk, a batch, as long as they fit.
+ *
+ * The files are read into the chunk buffer of controlInfo after room for the largest table, and the table of the
+ * batch is then written just before them, so that the batch is a single piece of memory: the number of files, a
+ * BatchPart with the index and length of each, and the files one after the other. Empty files are left out.
+ *
+ * @param controlInfo structure where the size and number of files of the batch are stored, and where it is read to
+ * @return pointer to the start of the batch, in the chunk buffer of controlInfo.
+ */
+static const unsigned char *get_batch(ControlInfo *controlInfo) {
+    unsigned char *data = controlInfo->chars_read + BATCH_TABLE_SIZE(MAX_BATCH_FILES);
+    unsigned char *table;
+    BatchPart parts[MAX_BATCH_FILES];
+    int numParts = 0;
+    long length = 0, n;
+    FileReader *reader;
+
+    while (numParts < MAX_BATCH_FILES && small_file_next()
+           && length + readers[file_order[next_file]].size <= chunk_size) {
+        reader = &readers[file_order[next_file++]];
+        n = read_small_file(reader, data + length);
+        if (n < 0) {
+            printf("ERROR: Unable to read the whole file: %s\n", filenames[reader->fileIndex]);
+            read_failed[reader->fileIndex] = 1;
+        }
+        if (n <= 0)
+            continue;
+
+        parts[numParts].fileIndex = reader->fileIndex;
+        parts[numParts++].length = (int) n;
+        length += n;
+    }
+
+    table = data - BATCH_TABLE_SIZE(numParts);
+    memcpy(table, &numParts, sizeof(int));
+    memcpy(table + sizeof(int), parts, numParts * sizeof(BatchPart));
+
+    // a batch belongs to no single file
+    controlInfo->fileIndex = -1;
+    controlInfo->offset = 0;
+    controlInfo->num_parts = numParts;
+    controlInfo->n_chars_read = numParts > 0 ? (int) (BATCH_TABLE_SIZE(numParts) + length) : 0;
+    return table;
+}
+
+/**
+ * \brief Retrieve the next chunk of the files, of up to chunk_size bytes.
+ *
+ * Operation carried out by the dispatcher, to send the work to the workers. Chunks are cut in turn from up to
+ * max_open_files files, opened largest first, so that chunks of several files are in flight at once and the next file
+ * is already under way when one drains. Memory mapped files are not copied: the chunk points into the mapping, which
+ * stays valid until release_data is called for the chunk. Files read through a stream are copied to the chunk buffer
+ * of controlInfo, with room for CHUNK_BUFFER_SIZE(chunk_size) bytes. Files smaller than a chunk are not opened for
+ * chunks of their own, but packed whole into batches, which take a turn as one more open file.
  *
- * Operation carried out by the dispatcher, to send the work to the workers
  * @param controlInfo structure containing all the info needed to get data to process
- * @return 1 if there's still data to read from the file, 0 otherwise.
+ * @param chunk set to the start of the chunk
+ * @return 1 if there's still data to read from the files, 0 otherwise.
+ */
+int get_data(ControlInfo *controlInfo, const unsigned char **chunk) {
+    FileReader *reader;
+    int numTurns;
+
+    while (true) {
+        while (num_open < max_open_files && !small_file_next() && file_available())
+            ;
+
+        // the small files left take the turn after the open files
+        numTurns = num_open + small_file_next();
+        if (numTurns == 0)
+            return 0;
+
+        if (current_open >= numTurns)
+            current_open = 0;
+        if (current_open == num_open) {
+            *chunk = get_batch(controlInfo);
+            current_open++;
+            if (controlInfo->n_chars_read > 0)
+                return 1;
+            continue;
+        }
+        reader = &readers[open_files[current_open]];
+
+        /* the file is closed once all its chunks were sent. */
+        if (file_drained(reader)) {
+            close_file(current_open);
+            continue;
+        }
+
+        // save file index to the crontrol structure
+        controlInfo->fileIndex = reader->fileIndex;
+        controlInfo->num_parts = 0;
+        *chunk = reader->mapped ? get_mapped_data(reader, controlInfo) : get_stream_data(reader, controlInfo);
+        current_open++;
+
+        if (controlInfo->n_chars_read > 0)
+            return 1;
+    }
+}
+
+/**
+ * \brief Tell that a chunk retrieved by get_data was sent, and the memory it points to is no longer needed.
+ *
+ * May be called from a thread other than the one retrieving the chunks.
+ *
+ * @param controlInfo structure describing the chunk
+ * @param chunk start of the chunk
  */
-int get_data(ControlInfo *controlInfo) {
+void release_data(ControlInfo *controlInfo, const unsigned char *chunk) {
+    // chunks of streams and batches were copied to the chunk buffer
+    if (chunk == NULL || chunk == controlInfo->chars_read || controlInfo->num_parts > 0)
+        return;
+
+    pthread_mutex_lock(&map_lock);
+    mapped_chunks[controlInfo->fileIndex]--;
+    unmap_if_unused(controlInfo->fileIndex);
+    pthread_mutex_unlock(&map_lock);
+}
+
+/**
+ * \brief Get the next byte range of the files to be sampled, to be read by a worker itself.
+ *
+ * The ranges of all the files are planned at once, and handed out a file at a time, in turns, so that the files are
+ * sampled together, until the estimates of each one are precise enough or all of its ranges were read.
+ *
+ * @param controlInfo structure where the file index, offset and length of the range are stored
+ * @return 1 if there's still a range to be read, 0 otherwise.
+ */
+static int get_sampled_range(ControlInfo *controlInfo) {
+    FileReader *reader;
+    long offset;
+
+    // the files are planned on the first call, a file that cannot be planned getting no ranges, and no results
+    for (; next_file < num_files; next_file++) {
+        reader = &readers[file_order[next_file]];
+        if (reader->size < 0) {
+            printf("ERROR: Unable to read the file, the workers can only read regular files: %s\n",
+                   filenames[reader->fileIndex]);
+            read_failed[reader->fileIndex] = 1;
+        } else if (!sampling_plan(reader->fileIndex, reader->size, chunk_size))
+            read_failed[reader->fileIndex] = 1;
+    }
 
-    int num_chars_read = 0;
-    int num_tokens_read = 0;
-    unsigned char chr;
-    int data_avail = 1;
+    // each file in turn, skipping the ones that need no more ranges
+    for (int tried = 0; tried < num_files; tried++) {
+        reader = &readers[file_order[current_open]];
+        current_open = (current_open + 1) % num_files;
+        if ((offset = sampling_next(reader->fileIndex, chunk_size)) < 0)
+            continue;
+
+        controlInfo->fileIndex = reader->fileIndex;
+        controlInfo->offset = offset;
+        controlInfo->num_parts = 0;
+        controlInfo->n_chars_read = reader->size - offset < chunk_size ? (int) (reader->size - offset) : chunk_size;
+        return 1;
+    }
 
-    if (!file_opened)
-        data_avail = file_available();
+    return 0;
+}
 
-    // save file index to the crontrol structure
-    controlInfo->fileIndex = files_idx;
+/**
+ * \brief Index the frames of a zstd file, so that the workers can decompress its ranges themselves.
+ *
+ * @param reader reading state of the file, whose size becomes the decompressed one
+ * @return 1 if the file was indexed, 0 if its frames do not all record their size or one is larger than the largest
+ * chunk.
+ */
+static int index_frames(FileReader *reader) {
+    long *offsets;
 
-    if (data_avail) {
-        /* read the next character and saves it until K tokens are constructed or the EOF character is found. */
-        while (num_tokens_read != K && !feof(fp)) {
-            chr = fgetc(fp);
-            controlInfo->chars_read[num_chars_read] = chr;
-            num_chars_read += 1;
+    if (!frame_index_open(filenames[reader->fileIndex], &reader->frames))
+        return 0;
 
-            if (chr == ' ')
-                num_tokens_read += 1;
+    offsets = reader->frames.offsets;
+    for (int k = 0; k < reader->frames.num_frames; k++)
+        if (offsets[k + 1] - offsets[k] > MAX_CHUNK_SIZE) {
+            frame_index_close(&reader->frames);
+            return 0;
         }
 
+    reader->size = offsets[reader->frames.num_frames];
+    reader->next_frame = 0;
+    return 1;
+}
+
+/**
+ * \brief End of the next byte range of an indexed zstd file.
+ *
+ * A range takes whole frames, as many as fit in a chunk and one at least, so that no frame is decompressed by two
+ * workers. As a worker reads the byte before its range, to find the boundary at its start, the ranges are moved one
+ * byte on: each one starts with the second byte of its first frame and ends with the first byte of the next frame.
+ *
+ * @param reader reading state of the file
+ * @return the offset of the end of the range.
+ */
+static long frame_range_end(FileReader *reader) {
+    long *offsets = reader->frames.offsets;
+    int last = reader->next_frame + 1;
+
+    while (last < reader->frames.num_frames && offsets[last + 1] - offsets[reader->next_frame] <= chunk_size)
+        last++;
+    reader->next_frame = last;
+
+    return last < reader->frames.num_frames && offsets[last] < reader->size ? offsets[last] + 1 : reader->size;
+}
+
+/**
+ * \brief Get the next byte range of the files, to be read by a worker itself.
+ *
+ * Operation carried out by the dispatcher, when the workers read the files. Only the size of the files is needed: each
+ * one is cut in ranges of chunk_size bytes, whose edges are fixed by the workers at the word boundaries around them.
+ * A zstd file is cut at its frames instead, which the workers decompress. The files are handed out largest first, and
+ * a file that the workers cannot read is reported and skipped.
+ *
+ * @param controlInfo structure where the file index, offset and length of the range are stored
+ * @return 1 if there's still a range to be read, 0 otherwise.
+ */
+int get_range(ControlInfo *controlInfo) {
+    FileReader *reader = num_open > 0 ? &readers[open_files[0]] : NULL;
+
+    if (sample_precision > 0)
+        return get_sampled_range(controlInfo);
+
+    /* move to the next file once all the ranges of the current one were handed out. */
+    while (reader == NULL || reader->range_offset == reader->size) {
+        if (reader != NULL)
+            frame_index_close(&reader->frames);
+        num_open = 0;
+        if (next_file >= num_files)
+            return 0;
+        reader = &readers[file_order[next_file++]];
+
+        // the workers must be able to read any range of the file
+        if (reader->compression != COMPRESSION_NONE
+            && (reader->compression != COMPRESSION_ZSTD || !index_frames(reader))) {
+            printf("ERROR: Unable to read the file, the workers can only decompress zstd files whose frames record "
+                   "their size: %s\n", filenames[reader->fileIndex]);
+            read_failed[reader->fileIndex] = 1;
+            reader = NULL;
+            continue;
+        }
+        if (reader->size < 0) {
+            printf("ERROR: Unable to read the file, the workers can only read regular files: %s\n",
+                   filenames[reader->fileIndex]);
+            read_failed[reader->fileIndex] = 1;
+            reader = NULL;
+            continue;
+        }
+
+        open_files[num_open++] = reader->fileIndex;
+        reader->range_offset = 0;
     }
-    controlInfo->n_chars_read = num_chars_read;
 
-    /* if it reached the end of the file. */
-    if (num_tokens_read == 0)
-        close_file();
+    controlInfo->fileIndex = reader->fileIndex;
+    controlInfo->offset = reader->range_offset;
+    controlInfo->num_parts = 0;
+    if (reader->frames.num_frames > 0)
+        controlInfo->n_chars_read = (int) (frame_range_end(reader) - reader->range_offset);
+    else
+        controlInfo->n_chars_read = reader->size - reader->range_offset < chunk_size
+                                    ? (int) (reader->size - reader->range_offset) : chunk_size;
+    reader->range_offset += controlInfo->n_chars_read;
 
-    return data_avail;
+    return 1;
 }
 
 /**
@@ -165,64 +771,95 @@ int get_data(ControlInfo *controlInfo) {
  * @param controlInfo structure containing all the info needed
  */
 void write_worker_results(ControlInfo *controlInfo) {
-    gbl_total_num_words[controlInfo->fileIndex] += controlInfo->num_words_read;
-
-    if (controlInfo->max_num_vowels > gbl_max_num_vowels[files_idx])
-        gbl_max_num_vowels[controlInfo->fileIndex] = controlInfo->max_num_vowels;
-
-    if (controlInfo->max_word_length > gbl_max_word_length[controlInfo->fileIndex])
-        gbl_max_word_length[controlInfo->fileIndex] = controlInfo->max_word_length ;
-
-    for (int i = 0; i < sizeof(gbl_word_lengths[controlInfo->fileIndex]) / sizeof(gbl_word_lengths[controlInfo->fileIndex][0]); i++)
-        gbl_word_lengths[controlInfo->fileIndex][i] += controlInfo->word_lengths[i];
-
-    for (int i = 0; i < sizeof(gbl_word_vowels[controlInfo->fileIndex]) / sizeof(gbl_word_vowels[controlInfo->fileIndex][0]); i++)
-        for (int j = 0; j < sizeof(gbl_word_vowels[controlInfo->fileIndex][0]) / sizeof(gbl_word_vowels[controlInfo->fileIndex][0][0]); j++)
-            gbl_word_vowels[controlInfo->fileIndex][i][j] += controlInfo->word_vowels[i][j];
+    wordstats_merge(&gbl_counts[controlInfo->fileIndex], &controlInfo->counts);
 }
 
 /**
  * \brief Print the obtained results on the console.
  *
- * Operation carried out by the dispatcher.
+ * Operation carried out by the dispatcher. The histograms have as many lengths as the longest word of each file. When
+ * the files are sampled, the counts are estimates, and the percentages of the lengths are followed by the half-widths
+ * of their 95% confidence intervals; the percentages of the vowels are point estimates, and are said to be. The files
+ * that could not be read whole are left out.
  *
- * @return EXIT_SUCCESS if it can print and save in disk, EXIT_FAILURE otherwise.
+ * @return EXIT_SUCCESS if it can print and save in disk, EXIT_FAILURE otherwise, or if a file could not be read whole.
  */
 int write_results() {
+    // number of words of each length, of the file being printed
+    int *word_lengths;
+    int max_word_length;
+    // estimated number of words of the file being printed, when the files are sampled, and its margin of error
+    double totalWords = 0.0, halfWidth;
+    // status returned, a failure if a file could not be read whole
+    int result = EXIT_SUCCESS;
+
     for (int fi = 0; fi < num_files; fi++) {
+        if (read_failed[fi] || gbl_counts[fi].read_failed) {
+            printf("\nERROR: No results for file: %s, which could not be read whole\n", filenames[fi]);
+            result = EXIT_FAILURE;
+            continue;
+        }
+
+        max_word_length = gbl_counts[fi].max_word_length;
+        word_lengths = malloc(sizeof(int) * (max_word_length + 1));
+        if (word_lengths == NULL) {
+            printf("ERROR: Unable to print the results for file: %s\n", filenames[fi]);
+            return EXIT_FAILURE;
+        }
+        wordstats_length_counts(&gbl_counts[fi], word_lengths, max_word_length);
+
         printf("\nResults for file: %s\n\n", filenames[fi]);
-        printf("Total number of words = %d;\n\n", gbl_total_num_words[fi]);
+        if (sample_precision > 0) {
+            totalWords = sampling_total_words(fi, &halfWidth);
+            printf("Total number of words = %.0f (estimated from %.1f%% of the file, +/- %.0f at 95%% confidence);\n\n",
+                   totalWords, 100 * sampling_fraction(fi), halfWidth);
+        } else
+            printf("Total number of words = %d;\n\n", gbl_counts[fi].num_words_read);
 
         printf("%2s", " ");
 
-        for (int i = 0; i < gbl_max_word_length[fi]; i++) {
+        for (int i = 0; i < max_word_length; i++) {
             printf("%6d", i+1);
         }
 
         printf( "\n");
         printf("%2s", " ");
 
-        for (int i = 0; i < gbl_max_word_length[fi]; i++)
-            printf("%6d", gbl_word_lengths[fi][i]);
+        // the words of each length in the file are estimated from their share of the words sampled
+        for (int i = 0; i < max_word_length; i++)
+            if (sample_precision > 0)
+                printf("%6.0f", (double) word_lengths[i] / gbl_counts[fi].num_words_read * totalWords);
+            else
+                printf("%6d", word_lengths[i]);
 
         printf("\n");
         printf("%2s", "");
 
-        for (int i = 0; i < gbl_max_word_length[fi]; i++)
-            printf("%6.2f", (double) gbl_word_lengths[fi][i] / gbl_total_num_words[fi] * 100);
+        for (int i = 0; i < max_word_length; i++)
+            printf("%6.2f", (double) word_lengths[i] / gbl_counts[fi].num_words_read * 100);
 
         printf("\n");
 
-        for (int i = 0; i <= gbl_max_word_length[fi]; i++) {
+        // half-widths of the 95% confidence intervals of the percentages
+        if (sample_precision > 0) {
+            printf("%2s", "+-");
+            for (int i = 0; i < max_word_length; i++)
+                printf("%6.2f", sampling_half_width(fi, i + 1));
+            printf("\n\n");
+            printf("Vowels per length (point estimates, without confidence intervals):\n");
+        }
+
+        for (int i = 0; i <= max_word_length; i++) {
             printf("%2d", i);
             if (i > 1) {
                 printf("%*s", 6 * (i - 1), "");
             }
-            for (int k = i - 1; k < gbl_max_word_length[fi]; k++) {
+            for (int k = i - 1; k < max_word_length; k++) {
                 if (k == -1)
                     k = 0;
-                if (gbl_word_lengths[k] != 0 && gbl_word_vowels[fi][i][k] != 0) {
-                    printf("%6.1f", (double) gbl_word_vowels[fi][i][k] / gbl_word_lengths[fi][k] * 100);
+                int num_vowels = wordstats_vowel_count(&gbl_counts[fi], i, k + 1);
+                if (word_lengths[k] != 0 && num_vowels != 0) {
+                    printf("%6.1f", (double) num_vowels / word_lengths[k] * 100);
                 }
                 else {
                     printf("%6.1f", 0.0);
@@ -231,7 +868,28 @@ int write_results() {
             printf("\n");
         }
         printf("\n");
+
+        if (text_metrics != 0)
+            metrics_print(&gbl_counts[fi]);
+        if (sketches_selected)
+            sketch_print(gbl_counts[fi].sketch);
+        free(word_lengths);
+    }
+
+    // the sketches of every file add up to the sketches of all of them
+    if (sketches_selected && num_files > 1) {
+        WordSketch *all = sketch_create();
+
+        if (all == NULL)
+            return EXIT_FAILURE;
+        for (int fi = 0; fi < num_files; fi++)
+            if (gbl_counts[fi].sketch != NULL && !read_failed[fi] && !gbl_counts[fi].read_failed)
+                sketch_merge(all, gbl_counts[fi].sketch);
+
+        printf("\nResults for all the files\n\n");
+        sketch_print(all);
+        free(all);
     }
 
-    return EXIT_SUCCESS;
+    return result;
 }
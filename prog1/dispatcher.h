@@ -17,14 +17,23 @@
 /** \brief The dispatcher loads the files to be processed */
 extern void presentFileNames(char *inputFilenames[], unsigned int nFiles);
 
-/** \brief Check if there are still files to be processed */
-extern int file_available();
+/** \brief Set the number of bytes of each chunk of work */
+extern void set_chunk_size(int chunkSize);
 
-/** \brief Close a file */
-extern void close_file();
+/** \brief Parse a number of bytes, with an optional K, M or G suffix */
+extern long parse_chunk_size(const char *text);
+
+/** \brief Set the number of files chunks are cut from at once */
+extern void set_open_files(int openFiles);
 
 /** \brief The dispacther gets a piece of data to be processed by a worker */
-extern int get_data(ControlInfo *controlInfo);
+extern int get_data(ControlInfo *controlInfo, const unsigned char **chunk);
+
+/** \brief The dispatcher no longer needs a piece of data, as it was sent */
+extern void release_data(ControlInfo *controlInfo, const unsigned char *chunk);
+
+/** \brief The dispatcher gets a byte range of the files to be read and processed by a worker */
+extern int get_range(ControlInfo *controlInfo);
 
 /** \brief The dispatcher stores the results received from the workers */
 extern void write_worker_results(ControlInfo *controlInfo);
@@ -0,0 +1,263 @@
+/**
+ *  \file langProfile.c
+ *
+ *  \brief Problem: Frequency of word lengths and the number of vowels
+ *
+ *  Implements the loading of language profiles and their compilation into the transition table of a byte-level DFA.
+ *
+ *  A profile is a text file where each line starts with a class name (vowels, separators or joiners) followed by
+ *  Unicode code points, written as U+XXXX, or ranges of code points, written as U+XXXX-U+YYYY. Text after a '#' is a
+ *  comment. Separators split words, vowels count towards the length and the vowels of a word, joiners (apostrophes,
+ *  for instance) join the characters around them into a single word without being counted, and every other code point
+ *  is a letter. Words are measured in code points.
+ *
+ *  The DFA reads the UTF-8 encoding of the text one byte at a time. Its states are the initial state, three states for
+ *  code points that are not in the profile (waiting for one, two or three more continuation bytes) and one state for
+ *  each prefix of the encoding of the code points in the profile. The action of a code point is taken on its last
+ *  byte. Invalid bytes are counted as single letters, and a sequence cut short by another lead byte is dropped.
+ *
+ *  \author Rafael Direito - June 2020
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tokenKernel.h"
+#include "langProfile.h"
+
+/** \brief largest length of a line of a profile. */
+#define MAX_LINE_LENGTH     4096
+
+/** \brief largest valid Unicode code point. */
+#define MAX_CODE_POINT      0x10FFFF
+
+/** \brief states used for the code points that are not in the profile, waiting for 1, 2 or 3 continuation bytes. */
+#define GENERIC_STATE(n)    (n)
+
+/** \brief number of states that exist in every DFA. */
+#define NUM_FIXED_STATES    4
+
+/** \brief states that follow each prefix of the encoding of the code points of the profile, -1 if there is none. */
+static int prefix_next[MAX_STATES][NUM_BYTES];
+
+/** \brief action of the code points of the profile, indexed by the state before and the last byte, -1 if none. */
+static int prefix_action[MAX_STATES][NUM_BYTES];
+
+/** \brief number of continuation bytes still missing in each state. */
+static int pending_bytes[MAX_STATES];
+
+/**
+ * \brief Encode a code point in UTF-8.
+ *
+ * @param codePoint code point to encode
+ * @param bytes array where the encoding is stored, with room for 4 bytes
+ * @return number of bytes of the encoding.
+ */
+static int encode_utf8(long codePoint, unsigned char *bytes) {
+    if (codePoint < 0x80) {
+        bytes[0] = (unsigned char) codePoint;
+        return 1;
+    }
+    if (codePoint < 0x800) {
+        bytes[0] = (unsigned char) (0xC0 | (codePoint >> 6));
+        bytes[1] = (unsigned char) (0x80 | (codePoint & 0x3F));
+        return 2;
+    }
+    if (codePoint < 0x10000) {
+        bytes[0] = (unsigned char) (0xE0 | (codePoint >> 12));
+        bytes[1] = (unsigned char) (0x80 | ((codePoint >> 6) & 0x3F));
+        bytes[2] = (unsigned char) (0x80 | (codePoint & 0x3F));
+        return 3;
+    }
+    bytes[0] = (unsigned char) (0xF0 | (codePoint >> 18));
+    bytes[1] = (unsigned char) (0x80 | ((codePoint >> 12) & 0x3F));
+    bytes[2] = (unsigned char) (0x80 | ((codePoint >> 6) & 0x3F));
+    bytes[3] = (unsigned char) (0x80 | (codePoint & 0x3F));
+    return 4;
+}
+
+/**
+ * \brief Add a code point of the profile to the prefix tables.
+ *
+ * @param codePoint code point to add
+ * @param action action taken when the code point is read
+ * @param numStates number of states created so far, updated with the new ones
+ * @return 1 if the code point was added, 0 if there are too many states.
+ */
+static int add_code_point(long codePoint, int action, int *numStates) {
+    unsigned char bytes[4];
+    int length = encode_utf8(codePoint, bytes);
+    int state = 0;
+
+    for (int i = 0; i < length - 1; i++) {
+        if (prefix_next[state][bytes[i]] < 0) {
+            if (*numStates == MAX_STATES)
+                return 0;
+            pending_bytes[*numStates] = length - 1 - i;
+            prefix_next[state][bytes[i]] = (*numStates)++;
+        }
+        state = prefix_next[state][bytes[i]];
+    }
+    prefix_action[state][bytes[length - 1]] = action;
+    return 1;
+}
+
+/**
+ * \brief Parse a code point written as U+XXXX.
+ *
+ * @param text text to parse
+ * @param end set to the first character after the code point
+ * @return the code point, or -1 if the text is not a valid code point.
+ */
+static long parse_code_point(const char *text, char **end) {
+    long codePoint;
+
+    if (toupper((unsigned char) text[0]) != 'U' || text[1] != '+' || !isxdigit((unsigned char) text[2]))
+        return -1;
+
+    codePoint = strtol(text + 2, end, 16);
+    if (codePoint > MAX_CODE_POINT || (codePoint >= 0xD800 && codePoint <= 0xDFFF))
+        return -1;
+
+    return codePoint;
+}
+
+/**
+ * \brief Read a language profile into the prefix tables.
+ *
+ * @param profileName name of the file with the profile
+ * @param numStates number of states created so far, updated with the new ones
+ * @return 1 if the profile was read, 0 otherwise.
+ */
+static int read_profile(const char *profileName, int *numStates) {
+    char line[MAX_LINE_LENGTH];
+    int line_number = 0;
+    FILE *profile = fopen(profileName, "r");
+
+    if (profile == NULL) {
+        fprintf(stderr, "ERROR: Unable to open the language profile: %s\n", profileName);
+        return 0;
+    }
+
+    while (fgets(line, sizeof line, profile) != NULL) {
+        char *comment = strchr(line, '#');
+        char *token;
+        int action;
+
+        line_number++;
+        if (comment != NULL)
+            *comment = '\0';
+
+        token = strtok(line, " \t\r\n");
+        if (token == NULL)
+            continue;
+
+        if (strcmp(token, "vowels") == 0)
+            action = ACTION_VOWEL;
+        else if (strcmp(token, "separators") == 0)
+            action = ACTION_SPLIT;
+        else if (strcmp(token, "joiners") == 0)
+            action = ACTION_NONE;
+        else {
+            fprintf(stderr, "ERROR: %s:%d: unknown class %s\n", profileName, line_number, token);
+            fclose(profile);
+            return 0;
+        }
+
+        while ((token = strtok(NULL, " \t\r\n")) != NULL) {
+            char *end;
+            long first = parse_code_point(token, &end);
+            long last = first;
+
+            if (first >= 0 && *end == '-')
+                last = parse_code_point(end + 1, &end);
+
+            if (first < 0 || last < first || *end != '\0') {
+                fprintf(stderr, "ERROR: %s:%d: invalid code point %s\n", profileName, line_number, token);
+                fclose(profile);
+                return 0;
+            }
+
+            for (long codePoint = first; codePoint <= last; codePoint++) {
+                if (codePoint >= 0xD800 && codePoint <= 0xDFFF)
+                    continue;
+                if (!add_code_point(codePoint, action, numStates)) {
+                    fprintf(stderr, "ERROR: %s: the profile needs more than %d states\n", profileName, MAX_STATES);
+                    fclose(profile);
+                    return 0;
+                }
+            }
+        }
+    }
+
+    fclose(profile);
+    return 1;
+}
+
+/**
+ * \brief Compile a language profile into the transition table of a byte-level DFA.
+ *
+ * @param profileName name of the file with the profile
+ * @param transitions transition table to fill, each entry holding the next state in the upper bits and the action in
+ * the lower two
+ * @return number of states of the DFA, or -1 if the profile could not be compiled.
+ */
+int compile_language_profile(const char *profileName, unsigned char transitions[MAX_STATES][NUM_BYTES]) {
+    int numStates = NUM_FIXED_STATES;
+
+    for (int state = 0; state < MAX_STATES; state++) {
+        for (int chr = 0; chr < NUM_BYTES; chr++) {
+            prefix_next[state][chr] = -1;
+            prefix_action[state][chr] = -1;
+        }
+    }
+
+    pending_bytes[0] = 0;
+    for (int n = 1; n < NUM_FIXED_STATES; n++)
+        pending_bytes[GENERIC_STATE(n)] = n;
+
+    if (!read_profile(profileName, &numStates))
+        return -1;
+
+    // Initial state: ASCII and invalid bytes are single letters, lead bytes wait for their continuation bytes.
+    for (int chr = 0; chr < NUM_BYTES; chr++) {
+        int next = 0;
+        int action = ACTION_LETTER;
+
+        if (prefix_next[0][chr] >= 0) {
+            next = prefix_next[0][chr];
+            action = ACTION_NONE;
+        } else if (prefix_action[0][chr] >= 0) {
+            action = prefix_action[0][chr];
+        } else if (chr >= 0xC2 && chr <= 0xDF) {
+            next = GENERIC_STATE(1);
+            action = ACTION_NONE;
+        } else if (chr >= 0xE0 && chr <= 0xEF) {
+            next = GENERIC_STATE(2);
+            action = ACTION_NONE;
+        } else if (chr >= 0xF0 && chr <= 0xF4) {
+            next = GENERIC_STATE(3);
+            action = ACTION_NONE;
+        }
+        transitions[0][chr] = (unsigned char) ((next << 2) | action);
+    }
+
+    // Remaining states: continuation bytes follow the prefixes, other bytes start over from the initial state.
+    for (int state = 1; state < numStates; state++) {
+        for (int chr = 0; chr < NUM_BYTES; chr++) {
+            if (chr < 0x80 || chr > 0xBF)
+                transitions[state][chr] = transitions[0][chr];
+            else if (prefix_next[state][chr] >= 0)
+                transitions[state][chr] = (unsigned char) ((prefix_next[state][chr] << 2) | ACTION_NONE);
+            else if (prefix_action[state][chr] >= 0)
+                transitions[state][chr] = (unsigned char) prefix_action[state][chr];
+            else if (pending_bytes[state] == 1)
+                transitions[state][chr] = ACTION_LETTER;
+            else
+                transitions[state][chr] = (unsigned char) ((GENERIC_STATE(pending_bytes[state] - 1) << 2) | ACTION_NONE);
+        }
+    }
+
+    return numStates;
+}
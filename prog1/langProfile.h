@@ -0,0 +1,19 @@
+/**
+ *  \file langProfile.h (header file)
+ *
+ *  \brief Problem: Frequency of word lengths and the number of vowels
+ *
+ *  Language profiles header file
+ *
+ *  \author Rafael Direito - June 2020
+ */
+
+#include "tokenKernel.h"
+
+#ifndef LANGPROFILE_H_
+#define LANGPROFILE_H_
+
+/** \brief Compile a language profile into the transition table of a byte-level DFA. */
+extern int compile_language_profile(const char *profileName, unsigned char transitions[MAX_STATES][NUM_BYTES]);
+
+#endif
@@ -16,8 +16,72 @@
 /** \brief largest word length. */
 #define  WORD_LENGTH    20
 
-/** \brief number of tokens read by each worker. */
-#define  K              1000
+/** \brief default number of bytes of each chunk of work. */
+#define  DEFAULT_CHUNK_SIZE    (1 << 20)
+
+/** \brief smallest number of bytes of each chunk of work. */
+#define  MIN_CHUNK_SIZE        (1 << 10)
+
+/** \brief largest number of bytes of each chunk of work. */
+#define  MAX_CHUNK_SIZE        (1 << 30)
+
+/** \brief number of bytes of the sub-chunks the threads of a worker share a chunk in. */
+#define  SUB_CHUNK_SIZE        (64 * 1024)
+
+/** \brief largest number of threads of each worker. */
+#define  MAX_WORKER_THREADS    256
+
+/** \brief default number of chunks handed to each worker ahead of its results. */
+#define  DEFAULT_OUTSTANDING   2
+
+/** \brief largest number of chunks handed to each worker ahead of its results. */
+#define  MAX_OUTSTANDING       64
+
+/** \brief default number of chunks the dispatcher reads ahead of the ones handed to the workers. */
+#define  DEFAULT_READ_AHEAD    4
+
+/** \brief largest number of chunks the dispatcher reads ahead of the ones handed to the workers. */
+#define  MAX_READ_AHEAD        1024
+
+/** \brief default number of files the dispatcher cuts chunks from at once. */
+#define  DEFAULT_OPEN_FILES    2
+
+/** \brief largest number of files the dispatcher cuts chunks from at once. */
+#define  MAX_OPEN_FILES        64
+
+/** \brief largest number of small files packed whole into a single chunk. */
+#define  MAX_BATCH_FILES       256
+
+/** \brief largest number of bytes of the text of a word kept for the vocabulary, longer words being cut. */
+#define  MAX_WORD_TEXT         256
+
+/** \brief number of bits of the hash of a word that choose a register of the HyperLogLog sketch. */
+#define  SKETCH_REGISTER_BITS  12
+
+/** \brief number of rows of the count-min sketch. */
+#define  SKETCH_DEPTH          4
+
+/** \brief number of counters of each row of the count-min sketch. */
+#define  SKETCH_WIDTH          2048
+
+/** \brief number of most frequent words printed from the sketches. */
+#define  SKETCH_TOP_WORDS      16
+
+/** \brief number of candidates for the most frequent words kept by the sketches, more than are printed, so that a word
+ * frequent over all the chunks is not lost for missing the top of some of them. */
+#define  SKETCH_CANDIDATES     (8 * SKETCH_TOP_WORDS)
+
+/** \brief number of strata each file is split into when it is sampled, one range of each being read per round. */
+#define  SAMPLE_STRATA         16
+
+/** \brief number of rounds of ranges read from each sampled file before its precision is trusted. */
+#define  SAMPLE_MIN_ROUNDS     2
+
+/** \brief name of a file that stands for the standard input, read as a stream. */
+#define  STDIN_NAME            "-"
+
+/** \brief number of bytes each process sends, to all the others, in each round of the exchange of the vocabulary. */
+#define  SHUFFLE_BUFFER_SIZE   (64 << 20)
 
 
 #endif
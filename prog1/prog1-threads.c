@@ -0,0 +1,414 @@
+/**
+ *  \file prog1-threads.c
+ *
+ *  \brief Problem name: Frequency of word lengths and the number of vowels.
+ *
+ *  Shared memory version of prog1, without MPI: the dispatcher is the main thread, and the workers are threads of the
+ *  same process. The dispatcher cuts the files into chunks, exactly as for prog1, and deals them to the deques of the
+ *  workers; a worker that runs out of chunks steals the oldest chunk of another. Each worker keeps its own counts per
+ *  file, which the dispatcher adds up once all the workers are finished, so no lock is needed for them.
+ *
+ *  Build: gcc -O2 -pthread -o prog1-threads prog1-threads.c dispatcher.c wordstats.c tokenKernel.c langProfile.c
+ *  textMetrics.c vocabulary.c wordSketch.c sampling.c compressedInput.c chunkRing.c workDeque.c -lm -lz -lzstd
+ *
+ *  \author Rafael Direito - June 2020
+ */
+
+#include "dispatcher.h"
+#include "wordstats.h"
+#include "wordSketch.h"
+#include "textMetrics.h"
+#include "chunkRing.h"
+#include "workDeque.h"
+#include "controlInfo.h"
+#include "probConst.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <libgen.h>
+#include <pthread.h>
+
+/** \brief Declaration of function*/
+void command_usage(char *cmdName);
+
+/** \brief number of files passed as argument*/
+unsigned int numFiles;
+
+/** \brief name of the language profile passed as argument, NULL to use the built-in rules*/
+char *profileName = NULL;
+
+/** \brief number of bytes of each chunk of work*/
+int chunkSize = DEFAULT_CHUNK_SIZE;
+
+/** \brief number of files the dispatcher cuts chunks from at once*/
+int numOpenFiles = DEFAULT_OPEN_FILES;
+
+/** \brief number of worker threads*/
+int numThreads;
+
+/** \brief chunks waiting for each worker*/
+WorkDeque *deques;
+
+/** \brief counts of each worker, per file*/
+WordStats **workerStats;
+
+/** \brief number of chunks dealt to the workers that no worker took yet*/
+int numQueued = 0;
+
+/** \brief flag that indicates that the dispatcher will not deal more chunks*/
+bool isDealingDone = false;
+
+/** \brief lock of numQueued and isDealingDone*/
+pthread_mutex_t queueLock = PTHREAD_MUTEX_INITIALIZER;
+
+/** \brief signaled when a chunk is dealt, or the dealing is done*/
+pthread_cond_t queueCond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * \brief Get the next chunk of a worker: the newest of its own deque, or else the oldest of the deque of another.
+ *
+ * @param workerId number of the worker
+ * @return the chunk, or NULL if every deque is empty.
+ */
+RingEntry *find_work(int workerId) {
+    RingEntry *entry = deque_pop(&deques[workerId]);
+
+    for (int i = 1; i < numThreads && entry == NULL; i++)
+        entry = deque_steal(&deques[(workerId + i) % numThreads]);
+
+    return entry;
+}
+
+/**
+ * \brief Count a batch of small files, each file whole and on its own, into the counts of the files.
+ *
+ * @param batch the table of the batch, the number of files and a BatchPart for each, followed by the files
+ * @param fileStats counts of all the files
+ */
+void count_batch(const unsigned char *batch, WordStats *fileStats) {
+    int numParts;
+    BatchPart part;
+    const unsigned char *data;
+
+    memcpy(&numParts, batch, sizeof(int));
+    data = batch + BATCH_TABLE_SIZE(numParts);
+
+    for (int i = 0; i < numParts; i++) {
+        memcpy(&part, batch + BATCH_TABLE_SIZE(i), sizeof(BatchPart));
+        wordstats_restart(&fileStats[part.fileIndex]);
+        wordstats_feed(&fileStats[part.fileIndex], data, part.length);
+        data += part.length;
+    }
+}
+
+/**
+ * Implement the life cycle of a worker thread.
+ * It counts the chunks it takes into its own counts, until the dispatcher dealt all of them and none is left.
+ * @param arg number of the worker
+ * @return NULL
+ */
+void *worker(void *arg) {
+    int workerId = (int) (intptr_t) arg;
+    WordStats *fileStats = workerStats[workerId];
+    RingEntry *entry;
+    // if true, there is still work to be done
+    bool isWorkToBeDone = true;
+
+    while (isWorkToBeDone) {
+        entry = find_work(workerId);
+
+        pthread_mutex_lock(&queueLock);
+        if (entry != NULL)
+            numQueued--;
+        else {
+            // another worker may be taking the last chunk that was dealt: look again once it is gone
+            while (numQueued == 0 && !isDealingDone)
+                pthread_cond_wait(&queueCond, &queueLock);
+            isWorkToBeDone = numQueued > 0 || !isDealingDone;
+        }
+        pthread_mutex_unlock(&queueLock);
+
+        if (entry != NULL) {
+            if (entry->info.num_parts > 0)
+                count_batch(entry->chunk, fileStats);
+            else {
+                // chunks start and end at word boundaries
+                wordstats_restart(&fileStats[entry->info.fileIndex]);
+                wordstats_feed(&fileStats[entry->info.fileIndex], entry->chunk, entry->info.n_chars_read);
+            }
+            release_data(&entry->info, entry->chunk);
+            ring_release(entry);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Implement the dispatcher life cycle.
+ * It cuts the files into chunks and deals them to the deques of the workers, in turn; then it adds up the counts of
+ * the workers and prints the results.
+ * @param filenames name of the files to be processed
+ * @param nFiles number of files to be processed
+ * @return EXIT_SUCCESS if the results of every file were printed, EXIT_FAILURE otherwise.
+ */
+int dispatcher(char **filenames, unsigned int nFiles) {
+    // number of the next worker that will be dealt a chunk
+    int workerId = 0;
+    // number of workers whose deque and counts are set up
+    int numInitialized = 0;
+    // number of worker threads started
+    int numStarted = 0;
+    pthread_t *threads = malloc(numThreads * sizeof(pthread_t));
+    ControlInfo controlInfo;
+    // entry of the chunk ring with the next chunk
+    RingEntry *entry;
+    // each worker may hold one chunk while two more wait in each deque, then the dispatcher waits for a free entry
+    int ringCapacity = numThreads * (DEFAULT_OUTSTANDING + 1);
+    bool isReady;
+    // status of the program, a failure if the workers could not start or the results of a file could not be printed
+    int result = EXIT_FAILURE;
+    // time limits
+    struct timespec t0, t1;
+
+    // get the starting time: the time of the process would add up the time of every thread
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    // Present the filenames
+    presentFileNames(filenames, nFiles);
+
+    deques = malloc(numThreads * sizeof(WorkDeque));
+    workerStats = malloc(numThreads * sizeof(WordStats *));
+    isReady = threads != NULL && deques != NULL && workerStats != NULL && ring_init(ringCapacity, CHUNK_BUFFER_SIZE(chunkSize));
+    // a worker steals from the deques of the others as soon as it starts, so every deque is set up before any thread
+    for (int i = 0; i < numThreads && isReady; i++) {
+        workerStats[i] = malloc(nFiles * sizeof(WordStats));
+        isReady = workerStats[i] != NULL && deque_init(&deques[i], ringCapacity);
+        if (isReady) {
+            for (unsigned int fi = 0; fi < nFiles; fi++)
+                wordstats_init(&workerStats[i][fi]);
+            numInitialized++;
+        } else
+            free(workerStats[i]);
+    }
+    for (int i = 0; i < numThreads && isReady; i++) {
+        isReady = pthread_create(&threads[i], NULL, worker, (void *) (intptr_t) i) == 0;
+        if (isReady)
+            numStarted++;
+    }
+    if (!isReady)
+        fprintf(stderr, "ERROR: Unable to start the worker threads\n");
+
+    // deal the chunks, waiting for a free entry of the ring when the workers are behind
+    while (isReady) {
+        entry = ring_reserve();
+        if (!get_data(&entry->info, &entry->chunk)) {
+            ring_release(entry);
+            break;
+        }
+
+        deque_push(&deques[workerId], entry);
+        workerId = (workerId + 1) % numThreads;
+
+        pthread_mutex_lock(&queueLock);
+        numQueued++;
+        pthread_cond_signal(&queueCond);
+        pthread_mutex_unlock(&queueLock);
+    }
+
+    pthread_mutex_lock(&queueLock);
+    isDealingDone = true;
+    pthread_cond_broadcast(&queueCond);
+    pthread_mutex_unlock(&queueLock);
+
+    for (int i = 0; i < numStarted; i++)
+        pthread_join(threads[i], NULL);
+
+    // every worker is finished: add up their counts, and save them in the dispatcher
+    if (isReady) {
+        for (unsigned int fi = 0; fi < nFiles; fi++) {
+            WordStats total;
+
+            wordstats_init(&total);
+            for (int i = 0; i < numThreads; i++)
+                wordstats_merge(&total.counts, &workerStats[i][fi].counts);
+            controlInfo.fileIndex = fi;
+            controlInfo.counts = total.counts;
+            write_worker_results(&controlInfo);
+            wordstats_free_counts(&total.counts);
+        }
+
+        // Print the results obtained
+        result = write_results();
+    }
+
+    for (int i = 0; i < numInitialized; i++) {
+        deque_destroy(&deques[i]);
+        for (unsigned int fi = 0; fi < nFiles; fi++)
+            wordstats_free_counts(&workerStats[i][fi].counts);
+        free(workerStats[i]);
+    }
+    ring_destroy();
+    free(deques);
+    free(workerStats);
+    free(threads);
+
+    // print elapsed time
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf ("\nElapsed time = %.6f s\n\n", (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+    return result;
+}
+
+
+/**
+ * \brief Verify if the console command was well executed.
+ *
+ * @param argc total number of arguments in the command.
+ * @param argv pointer to the array that contains the arguments in the command.
+ * @return EXIT_SUCCESS if the command was correctly executed, EXIT_FAILURE otherwise.
+ */
+int process_command(int argc, char *argv[], char **filenames) {
+    /* option chosen by the user */
+    int opt;
+    /* end of a number given as argument */
+    char *end;
+
+    do {
+        switch ((opt = getopt (argc, argv, "ab:hf:l:m:t:"))) {
+            case 'a': /* word sketches */
+                sketches_selected = 1;
+                break;
+            case 'b': /* chunk size */
+                chunkSize = (int) parse_chunk_size(optarg);
+                if (chunkSize < 0) {
+                    fprintf(stderr, "%s: invalid chunk size: %s (from %d to %d bytes)\n", basename (argv[0]), optarg,
+                            MIN_CHUNK_SIZE, MAX_CHUNK_SIZE);
+                    command_usage(basename (argv[0]));
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'f': /* files cut at once */
+                numOpenFiles = (int) strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || numOpenFiles < 1 || numOpenFiles > MAX_OPEN_FILES) {
+                    fprintf(stderr, "%s: invalid number of files cut at once: %s (from 1 to %d)\n", basename (argv[0]),
+                            optarg, MAX_OPEN_FILES);
+                    command_usage(basename (argv[0]));
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'l': /* language profile */
+                profileName = optarg;
+                break;
+            case 'm': /* text metrics */
+                if (!metrics_select(optarg)) {
+                    fprintf(stderr, "%s: invalid metrics: %s\n", basename (argv[0]), optarg);
+                    command_usage(basename (argv[0]));
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 't': /* worker threads */
+                numThreads = (int) strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || numThreads < 1 || numThreads > MAX_WORKER_THREADS) {
+                    fprintf(stderr, "%s: invalid number of threads: %s (from 1 to %d)\n", basename (argv[0]), optarg,
+                            MAX_WORKER_THREADS);
+                    command_usage(basename (argv[0]));
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'h': /* help mode */
+                command_usage(basename (argv[0]));
+                return EXIT_FAILURE;
+            case '?': /* invalid option */
+                fprintf(stderr, "%s: invalid option\n", basename (argv[0]));
+                command_usage(basename (argv[0]));
+                return EXIT_FAILURE;
+            case -1:
+                break;
+        }
+    } while (opt != -1);
+
+    /* if there are no filenames in the command */
+    if (optind == argc) {
+        fprintf(stderr, "%s: invalid format\n", basename (argv[0]));
+        command_usage(basename (argv[0]));
+        return EXIT_FAILURE;
+    }
+
+    /* the standard input can be read only once */
+    for (int o = optind, numStdin = 0; o < argc; o++)
+        if (strcmp(argv[o], STDIN_NAME) == 0 && ++numStdin > 1) {
+            fprintf(stderr, "%s: the standard input (%s) can only be named once\n", basename (argv[0]), STDIN_NAME);
+            command_usage(basename (argv[0]));
+            return EXIT_FAILURE;
+        }
+
+    /* saves the filenames in the array */
+    numFiles = argc - optind;
+    for (int o = optind; o < argc; o++)
+        filenames[o - optind] = argv[o];
+
+    return EXIT_SUCCESS;
+}
+
+
+/**
+ * \brief Print command usage.
+ *
+ * A message specifying how the program should be called is printed.
+ *
+ * @param cmdName pointer with the name of the command
+ */
+void command_usage(char *cmdName) {
+    fprintf (stderr, "\nSynopsis: %s [OPTIONS] [filename1 filename2 ...]\n"
+                     "  OPTIONS:\n"
+                     "  -a      --- estimate the number of distinct words and the most frequent words, in fixed memory\n"
+                     "  -b size --- number of bytes of each chunk of work, with an optional K, M or G suffix (1M)\n"
+                     "  -f num  --- number of files chunks are cut from at once, largest first (2)\n"
+                     "  -h      --- print this help\n"
+                     "  -l name --- language profile with the vowels, separators and joining marks\n"
+                     "  -m list --- also compute, in the same pass, the metrics of the list, separated by commas: letters,\n"
+                     "              bigrams, sentences and consonants, or all\n"
+                     "  -t num  --- number of worker threads (one per processor)\n"
+                     "  Files compressed with gzip or zstd are decompressed on the fly. The filename - reads the standard\n"
+                     "  input, and it and any pipe are counted as their data arrives.\n", cmdName);
+}
+
+
+/**
+ * Main method
+ * @param argc
+ * @param argv
+ * @return
+ */
+int main(int argc, char **argv) {
+    // allocate memory for the filenames of the files to be processed
+    char **filenames = malloc((argc - 1) * sizeof(char *));
+    long numProcessors = sysconf(_SC_NPROCESSORS_ONLN);
+
+    numThreads = numProcessors < 1 ? 1 : numProcessors > MAX_WORKER_THREADS ? MAX_WORKER_THREADS : (int) numProcessors;
+
+    // process the command and build the character classification tables according to it
+    int command_result = process_command(argc, argv, filenames);
+    if (command_result == EXIT_SUCCESS) {
+        if (profileName != NULL) {
+            if (!load_classifier(profileName))
+                command_result = EXIT_FAILURE;
+        } else
+            init_classifier();
+    }
+    if (command_result != EXIT_SUCCESS)
+        return command_result;
+
+    set_chunk_size(chunkSize);
+    set_open_files(numOpenFiles);
+
+    // launch dispatcher
+    command_result = dispatcher(filenames, numFiles);
+
+    free(filenames);
+    return command_result;
+}
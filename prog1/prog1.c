@@ -1,6 +1,14 @@
 #include <mpi.h>
 #include "dispatcher.h"
 #include "worker.h"
+#include "wordstats.h"
+#include "wordSketch.h"
+#include "rangeReader.h"
+#include "chunkRing.h"
+#include "tokenKernel.h"
+#include "textMetrics.h"
+#include "vocabulary.h"
+#include "sampling.h"
 #include "controlInfo.h"
 #include "probConst.h"
 #include <stdio.h>
@@ -12,29 +20,495 @@
 #include <time.h>
 #include <ctype.h>
 #include <libgen.h>
+#include <pthread.h>
+
+/* Tags of the messages between the dispatcher and the workers */
+#define TAG_WORK    1       /* a chunk, or the description of a byte range */
+#define TAG_STOP    2       /* no more work, without payload */
+#define TAG_DONE    3       /* a piece of work was counted, without payload */
+#define TAG_FILE    4       /* the index of the file of the chunks that follow */
+#define TAG_BATCH   5       /* small files packed whole into a single chunk, with the table of their files */
+#define TAG_SLOT    6       /* a chunk left in a slot of the shared window, as a SlotInfo */
+#define TAG_SAMPLE  7       /* the encoded counts of a sampled byte range, following the TAG_DONE that answers it */
+
+/** \brief Chunk handed to a worker through the shared window: its slot, where it starts in the slot, its size and,
+ * for a batch, its number of files. */
+typedef struct {
+    int index;
+    int offset;
+    int length;
+    int num_parts;
+} SlotInfo;
 
 /** \brief Declaration of function*/
 void command_usage(char *cmdName);
 
+/** \brief Declaration of functions*/
+int ring_capacity();
+void free_chunk_window();
+
 /** \brief number of the next worker that will receive work to do*/
 int currWorker = 1;
 
 /** \brief workers count*/
 int numWorkers;
 
+/** \brief number of files passed as argument*/
+unsigned int numFiles;
+
+/** \brief name of the language profile passed as argument, NULL to use the built-in rules*/
+char *profileName = NULL;
+
+/** \brief how the files are read: by the dispatcher, or by the workers through MPI-IO or pread*/
+int readMethod = READ_MESSAGES;
+
+/** \brief number of bytes of each chunk of work*/
+int chunkSize = DEFAULT_CHUNK_SIZE;
+
+/** \brief number of files the dispatcher cuts chunks from at once*/
+int numOpenFiles = DEFAULT_OPEN_FILES;
+
+/** \brief number of chunks handed to each worker ahead of its results*/
+int numOutstanding = DEFAULT_OUTSTANDING;
+
+/** \brief number of threads of each worker*/
+int numThreads = 1;
+
+/** \brief number of chunks read ahead of the ones handed to the workers*/
+int numReadAhead = DEFAULT_READ_AHEAD;
+
+/** \brief if true, the chunks are handed to the workers on the node of the dispatcher through a shared window*/
+bool sharedChunks = false;
+
+/** \brief window with the chunk slots shared by the processes on the node of the dispatcher*/
+MPI_Win chunkWindow;
+
+/** \brief chunk slots of the shared window, one for each entry of the chunk ring, NULL if the process has none*/
+unsigned char *chunkSlots = NULL;
+
+/** \brief number of bytes of each chunk slot*/
+int slotSize;
+
+/** \brief if true for a worker, it shares the window of chunk slots with the dispatcher*/
+bool *isLocalWorker;
+
+/** \brief if true, the dispatcher counts chunks itself while the workers hold all the chunks they may*/
+bool dispatcherCounts = true;
+
+/** \brief if true, the occupancy of the chunk ring is printed with the results*/
+bool showRingStats = false;
+
+/** \brief start of the names of the files the vocabulary is written to, one per process, NULL if it is not counted*/
+char *vocabularyPrefix = NULL;
+
+/** \brief number of distinct words of all the files, known by the root process once the vocabulary is exchanged*/
+long long vocabularySize = 0;
+
+/** \brief chunks each worker has not answered yet, numOutstanding per worker, oldest first*/
+RingEntry **pendingEntries;
+
+/** \brief position of the oldest chunk each worker has not answered yet, in pendingEntries*/
+int *pendingFirst;
+
+/** \brief number of chunks each worker has not answered yet*/
+int *pendingCount;
+
+/** \brief file of the last chunk sent to each worker, -1 if none*/
+int *workerFile;
+
+/**
+ * \brief Get the next piece of work: a chunk read by the dispatcher, or a byte range the worker reads itself.
+ *
+ * @param controlInfo structure where the description of the work is stored
+ * @param chunk set to the start of the chunk, when the dispatcher reads the files
+ * @return 1 if there's still work to be done, 0 otherwise.
+ */
+int get_work(ControlInfo *controlInfo, const unsigned char **chunk) {
+    if (readMethod == READ_MESSAGES)
+        return get_data(controlInfo, chunk);
+
+    *chunk = NULL;
+    return get_range(controlInfo);
+}
+
+/**
+ * \brief Reader thread of the dispatcher: retrieve the pieces of work into the chunk ring, ahead of the sender.
+ *
+ * @param arg unused
+ * @return NULL
+ */
+void *read_chunks(void *arg) {
+    RingEntry *entry;
+
+    while (true) {
+        entry = ring_reserve();
+        if (!get_work(&entry->info, &entry->chunk)) {
+            ring_release(entry);
+            break;
+        }
+        ring_publish(entry);
+    }
+
+    ring_close();
+    return NULL;
+}
+
+/**
+ * \brief Send a chunk to a worker on the node of the dispatcher through the slot of its entry in the shared window.
+ *
+ * Chunks of streams and batches were read into the slot already; chunks of memory mapped files are copied to it.
+ *
+ * @param workerId rank of the worker
+ * @param entry entry of the chunk ring with the chunk
+ * @param request request of the send, left null as the message is sent at once
+ */
+void send_slot(int workerId, RingEntry *entry, MPI_Request *request) {
+    unsigned char *slot = entry->info.chars_read;
+    SlotInfo slotInfo = {entry->index, 0, entry->info.n_chars_read, entry->info.num_parts};
+
+    if (entry->chunk >= slot && entry->chunk < slot + slotSize)
+        slotInfo.offset = (int) (entry->chunk - slot);
+    else
+        memcpy(slot, entry->chunk, entry->info.n_chars_read);
+
+    if (entry->info.num_parts == 0 && workerFile[workerId] != entry->info.fileIndex) {
+        workerFile[workerId] = entry->info.fileIndex;
+        MPI_Send(&workerFile[workerId], 1, MPI_INT, workerId, TAG_FILE, MPI_COMM_WORLD);
+    }
+
+    // the chunk must be in the window before the worker is told where it is
+    MPI_Win_sync(chunkWindow);
+    MPI_Send(&slotInfo, sizeof(SlotInfo), MPI_BYTE, workerId, TAG_SLOT, MPI_COMM_WORLD);
+    *request = MPI_REQUEST_NULL;
+}
+
+/**
+ * \brief Start sending a piece of work to a worker, and remember it until the worker answers.
+ *
+ * Chunks do not say which file they belong to: the worker is told when it changes, with a TAG_FILE message ahead of
+ * the chunk. Byte ranges carry their file, and batches of small files the file of each of their parts. The workers
+ * that share the window of chunk slots are only sent where the chunk is in the slot of its entry, once it is there.
+ *
+ * @param workerId rank of the worker
+ * @param entry entry of the chunk ring with the work
+ * @param request request of the send
+ */
+void send_work(int workerId, RingEntry *entry, MPI_Request *request) {
+    RingEntry **entries = pendingEntries + workerId * numOutstanding;
+
+    entries[(pendingFirst[workerId] + pendingCount[workerId]) % numOutstanding] = entry;
+    pendingCount[workerId]++;
+
+    // send message to worker: the chunk itself, or the description of the byte range it reads
+    if (chunkSlots != NULL && isLocalWorker[workerId])
+        send_slot(workerId, entry, request);
+    else if (entry->info.num_parts > 0)
+        MPI_Isend(entry->chunk, entry->info.n_chars_read, MPI_BYTE, workerId, TAG_BATCH, MPI_COMM_WORLD, request);
+    else if (readMethod == READ_MESSAGES) {
+        if (workerFile[workerId] != entry->info.fileIndex) {
+            workerFile[workerId] = entry->info.fileIndex;
+            MPI_Send(&workerFile[workerId], 1, MPI_INT, workerId, TAG_FILE, MPI_COMM_WORLD);
+        }
+        MPI_Isend(entry->chunk, entry->info.n_chars_read, MPI_BYTE, workerId, TAG_WORK, MPI_COMM_WORLD, request);
+    } else
+        MPI_Isend(&entry->info, CONTROL_INFO_HEADER_SIZE, MPI_BYTE, workerId, TAG_WORK, MPI_COMM_WORLD, request);
+}
+
+/**
+ * \brief Take the oldest piece of work a worker has not answered yet, the one its next answer is about.
+ *
+ * @param workerId rank of the worker
+ * @return entry of the chunk ring with the work.
+ */
+RingEntry *take_pending_entry(int workerId) {
+    RingEntry *entry = pendingEntries[workerId * numOutstanding + pendingFirst[workerId]];
+
+    pendingFirst[workerId] = (pendingFirst[workerId] + 1) % numOutstanding;
+    pendingCount[workerId]--;
+    return entry;
+}
+
+/**
+ * \brief Add the counts of a sampled byte range to the estimates of its file, and to the counts of the file kept by the
+ * dispatcher.
+ *
+ * @param entry entry of the chunk ring with the range
+ * @param sample counts of the range, which are freed
+ * @param fileStats counts of each file kept by the dispatcher
+ */
+void add_sample(RingEntry *entry, WordCounts *sample, WordStats *fileStats) {
+    sampling_add(entry->info.fileIndex, entry->info.n_chars_read, sample);
+    wordstats_merge(&fileStats[entry->info.fileIndex].counts, sample);
+    wordstats_free_counts(sample);
+}
+
+/**
+ * \brief Receive the counts of a sampled byte range a worker has just answered.
+ *
+ * @param workerId rank of the worker
+ * @param entry entry of the chunk ring with the range
+ * @param fileStats counts of each file kept by the dispatcher
+ */
+void receive_sample(int workerId, RingEntry *entry, WordStats *fileStats) {
+    MPI_Status status;
+    WordCounts sample;
+    int size;
+    int *encoded;
+
+    MPI_Probe(workerId, TAG_SAMPLE, MPI_COMM_WORLD, &status);
+    MPI_Get_count(&status, MPI_INT, &size);
+    encoded = malloc(size * sizeof(int));
+    MPI_Recv(encoded, size, MPI_INT, workerId, TAG_SAMPLE, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+    memset(&sample, 0, sizeof sample);
+    wordstats_decode(&sample, encoded);
+    add_sample(entry, &sample, fileStats);
+    free(encoded);
+}
+
+/**
+ * \brief Count a piece of work in the dispatcher itself, and give its entry back to the reader.
+ *
+ * @param entry entry of the chunk ring with the work
+ * @param fileStats counts of each file kept by the dispatcher
+ */
+void count_work(RingEntry *entry, WordStats *fileStats) {
+    ControlInfo controlInfo = entry->info;
+    WordStats sampleStats;
+
+    if (sample_precision > 0) {
+        wordstats_init(&sampleStats);
+        process_range(&controlInfo, &sampleStats);
+        add_sample(entry, &sampleStats.counts, fileStats);
+    } else if (readMethod != READ_MESSAGES)
+        process_range(&controlInfo, &fileStats[controlInfo.fileIndex]);
+    else {
+        controlInfo.chars_read = (unsigned char *) entry->chunk;
+        if (controlInfo.num_parts > 0)
+            process_batch(&controlInfo, fileStats);
+        else
+            process_data(&controlInfo, &fileStats[controlInfo.fileIndex]);
+    }
+
+    release_data(&entry->info, entry->chunk);
+    ring_release(entry);
+}
+
+/**
+ * \brief Exchange the vocabularies of the processes, so that each one owns a slice of the words of all the files, and
+ * write the slice of the calling process, sorted, to the file vocabularyPrefix.rank.
+ *
+ * The vocabularies of the files are added into one, and each word is sent to the process chosen by the upper bits of
+ * its hash, with MPI_Alltoallv. The words go in rounds of at most SHUFFLE_BUFFER_SIZE bytes sent and received by each
+ * process, until every process has sent all of its words, so no process holds more than its own words and its slice.
+ * Each word is sent as its count and the length of its text, followed by the text.
+ *
+ * @param counts counts of each file kept by the calling process, whose vocabularies are freed
+ * @return the number of distinct words of all the files, at the root process.
+ */
+long long shuffle_vocabulary(WordCounts *counts) {
+    int rank, numProcs, isMore, isAnyMore;
+    const int recordHeaderSize = sizeof(long long) + sizeof(int);
+    Vocabulary local, owned;
+    // entries of the local vocabulary, grouped by the process owning them, and the next one to send to each process
+    VocabularyEntry **byOwner;
+    int *ownerStart, *next;
+    int *sendCounts, *sendDisplacements, *receiveCounts, *receiveDisplacements;
+    int roomPerProcess;
+    char *sendBuffer, *receiveBuffer, *record;
+    char filename[FILENAME_MAX];
+    FILE *file;
+    long long numDistinct, totalDistinct = 0;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &numProcs);
+
+    memset(&local, 0, sizeof local);
+    memset(&owned, 0, sizeof owned);
+    for (int fi = 0; fi < numFiles; fi++) {
+        vocabulary_merge(&local, &counts[fi].vocabulary);
+        vocabulary_free(&counts[fi].vocabulary);
+    }
+
+    roomPerProcess = SHUFFLE_BUFFER_SIZE / numProcs;
+    if (roomPerProcess < recordHeaderSize + MAX_WORD_TEXT)
+        roomPerProcess = recordHeaderSize + MAX_WORD_TEXT;
+
+    byOwner = malloc((local.num_entries + 1) * sizeof(VocabularyEntry *));
+    ownerStart = calloc(numProcs + 1, sizeof(int));
+    next = malloc(numProcs * sizeof(int));
+    sendCounts = malloc(numProcs * sizeof(int));
+    sendDisplacements = malloc(numProcs * sizeof(int));
+    receiveCounts = malloc(numProcs * sizeof(int));
+    receiveDisplacements = malloc(numProcs * sizeof(int));
+    sendBuffer = malloc((size_t) roomPerProcess * numProcs);
+    receiveBuffer = malloc((size_t) roomPerProcess * numProcs);
+
+    // group the words by their owner, counting them first
+    for (int i = 0; i < local.size; i++)
+        if (local.entries[i].count != 0)
+            ownerStart[(local.entries[i].hash >> 32) % numProcs + 1]++;
+    for (int p = 0; p < numProcs; p++) {
+        ownerStart[p + 1] += ownerStart[p];
+        next[p] = ownerStart[p];
+    }
+    for (int i = 0; i < local.size; i++)
+        if (local.entries[i].count != 0)
+            byOwner[next[(local.entries[i].hash >> 32) % numProcs]++] = &local.entries[i];
+    for (int p = 0; p < numProcs; p++)
+        next[p] = ownerStart[p];
+
+    do {
+        // pack the next words of each owner, as many as fit in its room
+        isMore = 0;
+        for (int p = 0; p < numProcs; p++) {
+            record = sendBuffer + (size_t) p * roomPerProcess;
+            sendDisplacements[p] = p * roomPerProcess;
+            while (next[p] < ownerStart[p + 1]
+                   && record + recordHeaderSize + byOwner[next[p]]->length
+                      <= sendBuffer + (size_t) (p + 1) * roomPerProcess) {
+                memcpy(record, &byOwner[next[p]]->count, sizeof(long long));
+                memcpy(record + sizeof(long long), &byOwner[next[p]]->length, sizeof(int));
+                memcpy(record + recordHeaderSize, byOwner[next[p]]->text, byOwner[next[p]]->length);
+                record += recordHeaderSize + byOwner[next[p]]->length;
+                next[p]++;
+            }
+            sendCounts[p] = (int) (record - (sendBuffer + sendDisplacements[p]));
+            isMore |= next[p] < ownerStart[p + 1];
+        }
+
+        MPI_Alltoall(sendCounts, 1, MPI_INT, receiveCounts, 1, MPI_INT, MPI_COMM_WORLD);
+        receiveDisplacements[0] = 0;
+        for (int p = 1; p < numProcs; p++)
+            receiveDisplacements[p] = receiveDisplacements[p - 1] + receiveCounts[p - 1];
+        MPI_Alltoallv(sendBuffer, sendCounts, sendDisplacements, MPI_BYTE, receiveBuffer, receiveCounts,
+                      receiveDisplacements, MPI_BYTE, MPI_COMM_WORLD);
+
+        // add the words received to the slice of the calling process
+        record = receiveBuffer;
+        while (record < receiveBuffer + receiveDisplacements[numProcs - 1] + receiveCounts[numProcs - 1]) {
+            long long count;
+            int length;
+
+            memcpy(&count, record, sizeof(long long));
+            memcpy(&length, record + sizeof(long long), sizeof(int));
+            vocabulary_add(&owned, record + recordHeaderSize, length,
+                           vocabulary_hash(record + recordHeaderSize, length), count);
+            record += recordHeaderSize + length;
+        }
+
+        MPI_Allreduce(&isMore, &isAnyMore, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+    } while (isAnyMore);
+
+    vocabulary_free(&local);
+    free(byOwner);
+    free(ownerStart);
+    free(next);
+    free(sendCounts);
+    free(sendDisplacements);
+    free(receiveCounts);
+    free(receiveDisplacements);
+    free(sendBuffer);
+    free(receiveBuffer);
+
+    snprintf(filename, sizeof filename, "%s.%d", vocabularyPrefix, rank);
+    file = fopen(filename, "w");
+    if (file == NULL || !vocabulary_write(&owned, file))
+        fprintf(stderr, "ERROR: Unable to write the vocabulary to %s\n", filename);
+    if (file != NULL)
+        fclose(file);
+
+    numDistinct = owned.num_entries;
+    MPI_Reduce(&numDistinct, &totalDistinct, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    vocabulary_free(&owned);
+
+    return totalDistinct;
+}
+
+/**
+ * \brief Combine the word counts of the files kept by every process, at the root process.
+ *
+ * The counts of every other process are encoded sparsely, keeping only the histogram entries that are not zero, and
+ * gathered at the root process, which adds them to its own: the numbers of words and the histograms are summed, and
+ * the largest values kept.
+ *
+ * @param counts counts of each file kept by the calling process, to which the root process adds the ones of the others
+ */
+void reduce_counts(WordCounts *counts) {
+    int rank, numProcs, size = 0, position = 0;
+    int *sizes = NULL, *displacements = NULL, *encoded = NULL, *gathered = NULL;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &numProcs);
+
+    if (rank != 0) {
+        for (int fi = 0; fi < numFiles; fi++)
+            size += wordstats_encoded_size(&counts[fi]);
+        encoded = malloc(size * sizeof(int));
+        for (int fi = 0; fi < numFiles; fi++)
+            position += wordstats_encode(&counts[fi], encoded + position);
+    } else {
+        sizes = malloc(numProcs * sizeof(int));
+        displacements = malloc(numProcs * sizeof(int));
+    }
+
+    MPI_Gather(&size, 1, MPI_INT, sizes, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        displacements[0] = 0;
+        for (int p = 1; p < numProcs; p++)
+            displacements[p] = displacements[p - 1] + sizes[p - 1];
+        gathered = malloc((displacements[numProcs - 1] + sizes[numProcs - 1]) * sizeof(int));
+    }
+
+    MPI_Gatherv(encoded, size, MPI_INT, gathered, sizes, displacements, MPI_INT, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        for (int p = 1; p < numProcs; p++) {
+            position = displacements[p];
+            for (int fi = 0; fi < numFiles; fi++)
+                position += wordstats_decode(&counts[fi], gathered + position);
+        }
+    }
+
+    free(sizes);
+    free(displacements);
+    free(encoded);
+    free(gathered);
+}
+
 /**
  * Dispatcher function
  * Will be called, only by the dispatcher, to implement its life cycle
  * @param filenames name of the files passed by the user
  * @param nFiles num of files passed as argument
+ * @return EXIT_SUCCESS if the results of every file were printed, EXIT_FAILURE otherwise.
  */
-void dispatcher(char *filenames[], unsigned int nFiles) {
+int dispatcher(char *filenames[], unsigned int nFiles) {
     int workerId;
-    int lastWorkerReceivingInfo;
-    // control info structure for sending and receiving messages
+    // status of the program, a failure if the results of a file could not be printed
+    int result;
+    // counts of the files, combined from the workers at the end
+    WordCounts *totals = malloc(nFiles * sizeof(WordCounts));
+    // counts of each file of the chunks counted by the dispatcher itself
+    WordStats *fileStats = malloc(nFiles * sizeof(WordStats));
+    // if true, a worker answered
+    int isAnswered;
     ControlInfo controlInfo;
-    // if true, we will send work to the workers
+    // entry of the chunk ring with the next piece of work
+    RingEntry *entry;
+    // thread that reads the chunks ahead, into the chunk ring
+    pthread_t readerThread;
+    bool isRingReady;
+    int ringCapacity = ring_capacity();
+    // if true, there is still work to be sent to the workers
     bool isWorkToBeDone = true;
+    // number of chunks sent that were not answered yet
+    int numPending = 0;
+    // sends of the entries of the chunk ring, and receives of the answers of each worker, posted ahead
+    MPI_Request *sendRequests = malloc(ringCapacity * sizeof(MPI_Request));
+    MPI_Request *doneRequests = malloc(numWorkers * sizeof(MPI_Request));
+    int index;
     // time limits
     double t0, t1;
 
@@ -44,46 +518,138 @@ void dispatcher(char *filenames[], unsigned int nFiles) {
     // Present the filenames
     presentFileNames(filenames, nFiles);
 
+    pendingEntries = malloc((numWorkers + 1) * numOutstanding * sizeof(RingEntry *));
+    pendingFirst = calloc(numWorkers + 1, sizeof(int));
+    pendingCount = calloc(numWorkers + 1, sizeof(int));
+    workerFile = malloc((numWorkers + 1) * sizeof(int));
+    for (workerId = 1; workerId <= numWorkers; workerId++)
+        workerFile[workerId] = -1;
 
-    // while there are results to be computed, send data to the workers
-    while (get_data((ControlInfo *) &controlInfo)) {
+    // the reader fills the chunk ring while the chunks are sent
+    isRingReady = (sample_precision == 0 || sampling_start(nFiles))
+                  && (chunkSlots != NULL ? ring_init_shared(ringCapacity, slotSize, chunkSlots)
+                   : ring_init(ringCapacity, readMethod == READ_MESSAGES ? CHUNK_BUFFER_SIZE(chunkSize) : 0))
+                  && pthread_create(&readerThread, NULL, read_chunks, NULL) == 0;
+    if (!isRingReady) {
+        fprintf(stderr, "ERROR: Unable to start the reader of the chunks\n");
+        isWorkToBeDone = false;
+    }
 
-        // send infos to the workers in a parallelized way
-        for (workerId=1; workerId <= numWorkers; workerId++) {
+    // hand numOutstanding chunks to every worker, one round at a time
+    for (int round = 0; round < numOutstanding && isWorkToBeDone; round++) {
+        for (workerId = 1; workerId <= numWorkers && isWorkToBeDone; workerId++) {
+            entry = ring_take();
+            isWorkToBeDone = entry != NULL;
+            if (isWorkToBeDone) {
+                send_work(workerId, entry, &sendRequests[entry->index]);
+                numPending++;
+            }
+        }
+    }
 
-            // save the last worker receiving info
-            lastWorkerReceivingInfo = workerId;
+    for (workerId = 1; workerId <= numWorkers; workerId++) {
+        doneRequests[workerId - 1] = MPI_REQUEST_NULL;
+        if (pendingCount[workerId] > 0)
+            MPI_Irecv(NULL, 0, MPI_BYTE, workerId, TAG_DONE, MPI_COMM_WORLD, &doneRequests[workerId - 1]);
+    }
 
-            // tell worker there is work to be done
-            MPI_Send(&isWorkToBeDone, 1, MPI_C_BOOL, workerId, 0, MPI_COMM_WORLD);
+    for (int fi = 0; fi < nFiles; fi++)
+        wordstats_init(&fileStats[fi]);
 
-            // send message to worker
-            MPI_Send(&controlInfo, sizeof(ControlInfo), MPI_BYTE, workerId, 0, MPI_COMM_WORLD);
+    // as each answer arrives, from whichever worker is done first, give that worker its next chunk; while no answer
+    // is waiting, and so every worker holds all the chunks it may, the dispatcher counts the chunks read ahead itself
+    while (numPending > 0 || (isWorkToBeDone && numWorkers == 0)) {
+        isAnswered = 0;
+        if (numPending > 0)
+            MPI_Testany(numWorkers, doneRequests, &index, &isAnswered, MPI_STATUS_IGNORE);
 
-            // if there are no more data to process
-            if(workerId < numWorkers && !get_data((ControlInfo *) &controlInfo))
-                break;
+        if (!isAnswered && isWorkToBeDone && (dispatcherCounts || numWorkers == 0)) {
+            // without workers, there is nothing but counting to wait for
+            entry = numPending > 0 ? ring_try_take() : ring_take();
+            if (entry != NULL) {
+                count_work(entry, fileStats);
+                continue;
+            }
+            if (numPending == 0) {
+                isWorkToBeDone = false;
+                continue;
+            }
         }
 
-        for (workerId=1; workerId <= lastWorkerReceivingInfo; workerId++) {
+        if (!isAnswered)
+            MPI_Waitany(numWorkers, doneRequests, &index, MPI_STATUS_IGNORE);
+        workerId = index + 1;
+        numPending--;
 
-            // wait for workers response
-            MPI_Recv(&controlInfo, sizeof(ControlInfo), MPI_BYTE, workerId, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        // the chunk answered was received by the worker: its entry can be read into again
+        entry = take_pending_entry(workerId);
+        MPI_Wait(&sendRequests[entry->index], MPI_STATUS_IGNORE);
+        if (sample_precision > 0)
+            receive_sample(workerId, entry, fileStats);
+        release_data(&entry->info, entry->chunk);
+        ring_release(entry);
 
-            // save the results in the dispatcher
-            write_worker_results((ControlInfo *) &controlInfo);
+        if (isWorkToBeDone) {
+            entry = ring_take();
+            isWorkToBeDone = entry != NULL;
+        }
+        if (isWorkToBeDone) {
+            send_work(workerId, entry, &sendRequests[entry->index]);
+            numPending++;
         }
+
+        // post the receive of the next answer of the worker
+        if (pendingCount[workerId] > 0)
+            MPI_Irecv(NULL, 0, MPI_BYTE, workerId, TAG_DONE, MPI_COMM_WORLD, &doneRequests[index]);
     }
 
     // Inform workers there is no more work to be done
-    isWorkToBeDone = false;
-    for (int i = 1; i <= numWorkers; i++) {
-        // tell worker there is work to be done
-        MPI_Send(&isWorkToBeDone, 1, MPI_C_BOOL, i, 0, MPI_COMM_WORLD);
+    for (int i = 1; i <= numWorkers; i++)
+        MPI_Send(NULL, 0, MPI_BYTE, i, TAG_STOP, MPI_COMM_WORLD);
+
+    // combine the counts kept by the workers with the ones of the dispatcher, and save them in the dispatcher
+    for (int fi = 0; fi < nFiles; fi++)
+        totals[fi] = fileStats[fi].counts;
+    if (vocabulary_selected)
+        vocabularySize = shuffle_vocabulary(totals);
+    reduce_counts(totals);
+    for (int fi = 0; fi < nFiles; fi++) {
+        controlInfo.fileIndex = fi;
+        controlInfo.counts = totals[fi];
+        write_worker_results((ControlInfo *) &controlInfo);
+        wordstats_free_counts(&totals[fi]);
     }
+    free(totals);
+    free(fileStats);
+
+    // the reader has closed the ring by now
+    if (isRingReady)
+        pthread_join(readerThread, NULL);
+    ring_destroy();
+    free_chunk_window();
+    free(sendRequests);
+    free(doneRequests);
+    free(pendingEntries);
+    free(pendingFirst);
+    free(pendingCount);
+    free(workerFile);
 
     // Print the results obtained
-    write_results();
+    result = write_results();
+    if (sample_precision > 0)
+        sampling_stop();
+
+    // Print the size of the vocabulary and where its slices are
+    if (vocabulary_selected)
+        printf("\nVocabulary = %lld distinct words; written to %s.0 to %s.%d;\n", vocabularySize, vocabularyPrefix,
+               vocabularyPrefix, numWorkers);
+
+    // Print the occupancy of the chunk ring
+    if (showRingStats)
+        printf("\nChunk ring: %d entries, %.1f chunks ready on average and %d at most when one was taken; the sender "
+               "waited for the reader %ld times out of %ld chunks, and the reader for the sender %ld times\n",
+               ringCapacity, ring_stats.num_taken > 0 ? (double) ring_stats.sum_ready / ring_stats.num_taken : 0.0,
+               ring_stats.max_ready, ring_stats.num_empty, ring_stats.num_taken, ring_stats.num_full);
 
     // print for debugging
     //printf("The root process is leaving...\n");
@@ -91,6 +657,7 @@ void dispatcher(char *filenames[], unsigned int nFiles) {
     // print elapsed time
     t1 = ((double) clock ()) / CLOCKS_PER_SEC;
     printf ("\nElapsed time = %.6f s\n\n", t1 - t0);
+    return result;
 }
 
 
@@ -101,34 +668,274 @@ void dispatcher(char *filenames[], unsigned int nFiles) {
  * @param rank rank of the worker process
  */
 void worker(int rank) {
-    // if true, we will send work to the workers
-    bool isWorkToBeDone;
+    // status of the next message, to tell work from the end of it and to know its size
+    MPI_Status status;
 
     // control info for the worker
     ControlInfo controlInfo;
 
+    // counts of each file, kept over all the chunks of the worker, and file of the chunks received
+    WordStats *fileStats = malloc(numFiles * sizeof(WordStats));
+    WordCounts *counts = malloc(numFiles * sizeof(WordCounts));
+    int fileIndex = 0;
+
+    // counts of the byte range being sampled, sent back on their own, and their encoding
+    WordStats sampleStats;
+    int sampleSize;
+    int *encoded;
+
+    // a receive is posted for each chunk the dispatcher may send ahead, in a buffer of its own
+    int bufferSize = chunkSlots != NULL ? sizeof(SlotInfo) : readMethod == READ_MESSAGES ? CHUNK_BUFFER_SIZE(chunkSize)
+                                                                                           : CONTROL_INFO_HEADER_SIZE;
+    SlotInfo slotInfo;
+    unsigned char **buffers = malloc(numOutstanding * sizeof(unsigned char *));
+    MPI_Request *requests = malloc(numOutstanding * sizeof(MPI_Request));
+    int slot = 0;
+
+    for (int fi = 0; fi < numFiles; fi++)
+        wordstats_init(&fileStats[fi]);
+
+    // the threads of the worker share each chunk, a single one counts it if they cannot be started
+    if (!start_worker_threads(numThreads))
+        fprintf(stderr, "ERROR: Unable to start %d threads, counting with one\n", numThreads);
+
+    for (int i = 0; i < numOutstanding; i++) {
+        buffers[i] = malloc(bufferSize);
+        MPI_Irecv(buffers[i], bufferSize, MPI_BYTE, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &requests[i]);
+    }
+
     // worker lifecycle
     while (true) {
-        // check if there is work to be done
-        MPI_Recv(&isWorkToBeDone, 1, MPI_C_BOOL, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        // check if there is work to be done: messages match the receives in the order they were posted
+        MPI_Wait(&requests[slot], &status);
 
-        if (!isWorkToBeDone) {
+        if (status.MPI_TAG == TAG_STOP) {
             //printf("Worker with rank %d is leaving...\n", rank);
-            return;
+            break;
+        }
+
+        // Process data: the file of the chunks that follow, a chunk in the shared window, a batch of small files, a
+        // chunk, as long as the message, or a byte range to read
+        if (status.MPI_TAG == TAG_FILE)
+            memcpy(&fileIndex, buffers[slot], sizeof(int));
+        else if (status.MPI_TAG == TAG_SLOT) {
+            memcpy(&slotInfo, buffers[slot], sizeof(SlotInfo));
+            MPI_Win_sync(chunkWindow);
+            controlInfo.chars_read = chunkSlots + (size_t) slotInfo.index * slotSize + slotInfo.offset;
+            controlInfo.n_chars_read = slotInfo.length;
+            if (slotInfo.num_parts > 0)
+                process_batch((ControlInfo *) &controlInfo, fileStats);
+            else
+                process_data((ControlInfo *) &controlInfo, &fileStats[fileIndex]);
+        } else if (status.MPI_TAG == TAG_BATCH) {
+            controlInfo.chars_read = buffers[slot];
+            process_batch((ControlInfo *) &controlInfo, fileStats);
+        } else if (readMethod == READ_MESSAGES) {
+            controlInfo.chars_read = buffers[slot];
+            MPI_Get_count(&status, MPI_BYTE, &controlInfo.n_chars_read);
+            process_data((ControlInfo *) &controlInfo, &fileStats[fileIndex]);
+        } else {
+            memcpy(&controlInfo, buffers[slot], CONTROL_INFO_HEADER_SIZE);
+            if (sample_precision > 0) {
+                wordstats_init(&sampleStats);
+                process_range((ControlInfo *) &controlInfo, &sampleStats);
+            } else
+                process_range((ControlInfo *) &controlInfo, &fileStats[controlInfo.fileIndex]);
         }
 
-        // wait for work
-        MPI_Recv(&controlInfo, sizeof(ControlInfo), MPI_BYTE, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        // the buffer is free again, ready for a chunk sent in answer to this one
+        MPI_Irecv(buffers[slot], bufferSize, MPI_BYTE, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &requests[slot]);
+        slot = (slot + 1) % numOutstanding;
 
-        // set counts to zero
-        memset(controlInfo.word_lengths, 0, sizeof controlInfo.word_lengths);
-        memset(controlInfo.word_vowels, 0, sizeof controlInfo.word_vowels);
-        // Process data
-        process_data((ControlInfo *) &controlInfo);
+        // tell the root process the chunk was counted
+        if (status.MPI_TAG != TAG_FILE)
+            MPI_Send(NULL, 0, MPI_BYTE, 0, TAG_DONE, MPI_COMM_WORLD);
 
-        // send results to the root process
-        MPI_Send(&controlInfo, sizeof(ControlInfo), MPI_BYTE, 0, 0, MPI_COMM_WORLD);
+        // then send it the counts of a sampled range, which it receives once it takes the answer
+        if (sample_precision > 0) {
+            sampleSize = wordstats_encoded_size(&sampleStats.counts);
+            encoded = malloc(sampleSize * sizeof(int));
+            wordstats_encode(&sampleStats.counts, encoded);
+            MPI_Send(encoded, sampleSize, MPI_INT, 0, TAG_SAMPLE, MPI_COMM_WORLD);
+            wordstats_free_counts(&sampleStats.counts);
+            free(encoded);
+        }
     }
+
+    // the receives posted after the stop message will never match
+    for (int i = 0; i < numOutstanding; i++) {
+        if (i != slot) {
+            MPI_Cancel(&requests[i]);
+            MPI_Wait(&requests[i], MPI_STATUS_IGNORE);
+        }
+        free(buffers[i]);
+    }
+    free(buffers);
+    free(requests);
+    close_range_file();
+    stop_worker_threads();
+
+    // combine the counts of the files with the ones of the other workers, at the root process
+    for (int fi = 0; fi < numFiles; fi++)
+        counts[fi] = fileStats[fi].counts;
+    if (vocabulary_selected)
+        shuffle_vocabulary(counts);
+    reduce_counts(counts);
+    free_chunk_window();
+    for (int fi = 0; fi < numFiles; fi++)
+        wordstats_free_counts(&counts[fi]);
+    free(counts);
+    free(fileStats);
+}
+
+
+/**
+ * \brief Send the transition table built by the root process to the workers.
+ *
+ * @param rank rank of the calling process
+ */
+void share_classifier(int rank) {
+    MPI_Bcast(&num_states, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    if (num_states > 0) {
+        MPI_Bcast(transitions, num_states * NUM_BYTES, MPI_UNSIGNED_CHAR, 0, MPI_COMM_WORLD);
+
+        // prepare the tokenizer kernels for the received table
+        if (rank != 0)
+            start_classifier();
+    }
+}
+
+
+/**
+ * \brief Send the size of the chunks, the number of chunks sent ahead, the number of threads, how the files are read,
+ * the number of files, whether the chunks go through a shared window to the workers, the text metrics selected,
+ * whether the sketches of the words are kept, where the vocabulary is written, the precision the files are sampled to
+ * and, when the workers read the files themselves, the filenames.
+ *
+ * @param rank rank of the calling process
+ * @param filenames names of the files, allocated by the workers
+ */
+void share_work_settings(int rank, char ***filenames) {
+    MPI_Bcast(&chunkSize, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&numOutstanding, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&numThreads, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&readMethod, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&numFiles, 1, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&sharedChunks, 1, MPI_C_BOOL, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&text_metrics, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&sketches_selected, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&vocabulary_selected, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&sample_precision, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if (vocabulary_selected) {
+        int length = 0;
+
+        if (rank == 0)
+            length = strlen(vocabularyPrefix) + 1;
+        MPI_Bcast(&length, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        if (rank != 0)
+            vocabularyPrefix = malloc(length);
+        MPI_Bcast(vocabularyPrefix, length, MPI_CHAR, 0, MPI_COMM_WORLD);
+    }
+    if (readMethod == READ_MESSAGES)
+        return;
+
+    if (rank != 0)
+        *filenames = malloc(numFiles * sizeof(char *));
+
+    for (int i = 0; i < numFiles; i++) {
+        int length = 0;
+
+        if (rank == 0)
+            length = strlen((*filenames)[i]) + 1;
+        MPI_Bcast(&length, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+        if (rank != 0)
+            (*filenames)[i] = malloc(length);
+        MPI_Bcast((*filenames)[i], length, MPI_CHAR, 0, MPI_COMM_WORLD);
+    }
+
+    set_range_files(*filenames, readMethod);
+}
+
+
+/**
+ * \brief Number of entries of the chunk ring of the dispatcher, and of slots of the shared window.
+ *
+ * @return enough entries for the chunks handed to every worker ahead of its results, and the ones read ahead.
+ */
+int ring_capacity() {
+    return numWorkers * numOutstanding + numReadAhead;
+}
+
+
+/**
+ * \brief Allocate the window of chunk slots shared by the dispatcher and the workers on its node, when asked for.
+ *
+ * The dispatcher allocates a slot for each entry of its chunk ring, and the workers on its node map them: the chunks
+ * are written to the slots, and only where they are is sent. The workers on the other nodes, and all of them when the
+ * workers read the files themselves, keep receiving their work in messages.
+ *
+ * @param rank rank of the calling process
+ */
+void share_chunk_window(int rank) {
+    // communicator of the processes on the node of the calling process, the lowest rank first
+    MPI_Comm nodeComm;
+    MPI_Group nodeGroup, worldGroup;
+    int nodeSize, leader = rank;
+    MPI_Aint size;
+    int dispUnit;
+
+    if (!sharedChunks || readMethod != READ_MESSAGES)
+        return;
+
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &nodeComm);
+    MPI_Bcast(&leader, 1, MPI_INT, 0, nodeComm);
+
+    // only the node of the dispatcher shares a window
+    if (leader == 0) {
+        slotSize = CHUNK_BUFFER_SIZE(chunkSize);
+        MPI_Win_allocate_shared(rank == 0 ? (MPI_Aint) ring_capacity() * slotSize : 0, 1, MPI_INFO_NULL, nodeComm,
+                                &chunkSlots, &chunkWindow);
+        MPI_Win_shared_query(chunkWindow, 0, &size, &dispUnit, &chunkSlots);
+        MPI_Win_lock_all(MPI_MODE_NOCHECK, chunkWindow);
+    }
+
+    if (rank == 0) {
+        MPI_Comm_size(nodeComm, &nodeSize);
+        int *nodeRanks = malloc(nodeSize * sizeof(int));
+        int *worldRanks = malloc(nodeSize * sizeof(int));
+
+        for (int i = 0; i < nodeSize; i++)
+            nodeRanks[i] = i;
+        MPI_Comm_group(nodeComm, &nodeGroup);
+        MPI_Comm_group(MPI_COMM_WORLD, &worldGroup);
+        MPI_Group_translate_ranks(nodeGroup, nodeSize, nodeRanks, worldGroup, worldRanks);
+
+        isLocalWorker = calloc(numWorkers + 1, sizeof(bool));
+        for (int i = 1; i < nodeSize; i++)
+            isLocalWorker[worldRanks[i]] = true;
+
+        MPI_Group_free(&nodeGroup);
+        MPI_Group_free(&worldGroup);
+        free(nodeRanks);
+        free(worldRanks);
+    }
+
+    MPI_Comm_free(&nodeComm);
+}
+
+
+/**
+ * \brief Free the window of chunk slots, once the dispatcher and the workers on its node are all done with it.
+ */
+void free_chunk_window() {
+    if (chunkSlots == NULL)
+        return;
+
+    MPI_Win_unlock_all(chunkWindow);
+    MPI_Win_free(&chunkWindow);
+    chunkSlots = NULL;
 }
 
 
@@ -142,9 +949,102 @@ void worker(int rank) {
 int process_command(int argc, char *argv[], char **filenames) {
     /* option chosen by the user */
     int opt;
+    /* end of a number given as argument */
+    char *end;
 
     do {
-        switch ((opt = getopt (argc, argv, "h"))) {
+        switch ((opt = getopt (argc, argv, "ab:df:hl:m:o:p:q:r:st:v:w"))) {
+            case 'a': /* word sketches */
+                sketches_selected = 1;
+                break;
+            case 'b': /* chunk size */
+                chunkSize = (int) parse_chunk_size(optarg);
+                if (chunkSize < 0) {
+                    fprintf(stderr, "%s: invalid chunk size: %s (from %d to %d bytes)\n", basename (argv[0]), optarg,
+                            MIN_CHUNK_SIZE, MAX_CHUNK_SIZE);
+                    command_usage(basename (argv[0]));
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'f': /* files cut at once */
+                numOpenFiles = (int) strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || numOpenFiles < 1 || numOpenFiles > MAX_OPEN_FILES) {
+                    fprintf(stderr, "%s: invalid number of files cut at once: %s (from 1 to %d)\n", basename (argv[0]),
+                            optarg, MAX_OPEN_FILES);
+                    command_usage(basename (argv[0]));
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'l': /* language profile */
+                profileName = optarg;
+                break;
+            case 'm': /* text metrics */
+                if (!metrics_select(optarg)) {
+                    fprintf(stderr, "%s: invalid metrics: %s\n", basename (argv[0]), optarg);
+                    command_usage(basename (argv[0]));
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'o': /* chunks sent ahead */
+                numOutstanding = (int) strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || numOutstanding < 1 || numOutstanding > MAX_OUTSTANDING) {
+                    fprintf(stderr, "%s: invalid number of chunks sent ahead: %s (from 1 to %d)\n", basename (argv[0]),
+                            optarg, MAX_OUTSTANDING);
+                    command_usage(basename (argv[0]));
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'p': /* sampling precision */
+                sample_precision = strtod(optarg, &end);
+                if (*optarg == '\0' || *end != '\0' || !(sample_precision > 0 && sample_precision <= 100)) {
+                    fprintf(stderr, "%s: invalid sampling precision: %s (percentage points, over 0 and up to 100)\n",
+                            basename (argv[0]), optarg);
+                    command_usage(basename (argv[0]));
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'q': /* chunks read ahead */
+                numReadAhead = (int) strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || numReadAhead < 1 || numReadAhead > MAX_READ_AHEAD) {
+                    fprintf(stderr, "%s: invalid number of chunks read ahead: %s (from 1 to %d)\n", basename (argv[0]),
+                            optarg, MAX_READ_AHEAD);
+                    command_usage(basename (argv[0]));
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 's': /* chunk ring statistics */
+                showRingStats = true;
+                break;
+            case 't': /* threads of each worker */
+                numThreads = (int) strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || numThreads < 1 || numThreads > MAX_WORKER_THREADS) {
+                    fprintf(stderr, "%s: invalid number of threads: %s (from 1 to %d)\n", basename (argv[0]), optarg,
+                            MAX_WORKER_THREADS);
+                    command_usage(basename (argv[0]));
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'r': /* the workers read the files */
+                if (strcmp(optarg, "mpiio") == 0)
+                    readMethod = READ_MPIIO;
+                else if (strcmp(optarg, "pread") == 0)
+                    readMethod = READ_PREAD;
+                else {
+                    fprintf(stderr, "%s: invalid read method: %s\n", basename (argv[0]), optarg);
+                    command_usage(basename (argv[0]));
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'd': /* dispatcher does not count */
+                dispatcherCounts = false;
+                break;
+            case 'v': /* vocabulary */
+                vocabularyPrefix = optarg;
+                vocabulary_selected = 1;
+                break;
+            case 'w': /* shared window */
+                sharedChunks = true;
+                break;
             case 'h': /* help mode */
                 command_usage(basename (argv[0]));
                 return EXIT_FAILURE;
@@ -157,16 +1057,36 @@ int process_command(int argc, char *argv[], char **filenames) {
         }
     } while (opt != -1);
 
-    /* if there are no arguments in the command */
-    if (argc == 1) {
+    /* the sampled ranges are read by the workers, and only the word lengths and the vowels are estimated */
+    if (sample_precision > 0) {
+        if (text_metrics != 0 || vocabulary_selected || sketches_selected) {
+            fprintf(stderr, "%s: sampling cannot be combined with -a, -m or -v\n", basename (argv[0]));
+            command_usage(basename (argv[0]));
+            return EXIT_FAILURE;
+        }
+        if (readMethod == READ_MESSAGES)
+            readMethod = READ_PREAD;
+    }
+
+    /* if there are no filenames in the command */
+    if (optind == argc) {
         fprintf(stderr, "%s: invalid format\n", basename (argv[0]));
         command_usage(basename (argv[0]));
         return EXIT_FAILURE;
     }
 
+    /* the standard input can be read only once */
+    for (int o = optind, numStdin = 0; o < argc; o++)
+        if (strcmp(argv[o], STDIN_NAME) == 0 && ++numStdin > 1) {
+            fprintf(stderr, "%s: the standard input (%s) can only be named once\n", basename (argv[0]), STDIN_NAME);
+            command_usage(basename (argv[0]));
+            return EXIT_FAILURE;
+        }
+
     /* saves the filenames in the array */
-    for (int o = 1; o < argc; o++)
-        filenames[o - 1] = argv[o];
+    numFiles = argc - optind;
+    for (int o = optind; o < argc; o++)
+        filenames[o - optind] = argv[o];
 
     return EXIT_SUCCESS;
 }
@@ -182,7 +1102,28 @@ int process_command(int argc, char *argv[], char **filenames) {
 void command_usage(char *cmdName) {
     fprintf (stderr, "\nSynopsis: %s [OPTIONS] [filename1 filename2 ...]\n"
                      "  OPTIONS:\n"
-                     "  -h      --- print this help\n", cmdName);
+                     "  -a      --- estimate the number of distinct words and the most frequent words, in fixed memory\n"
+                     "  -b size --- number of bytes of each chunk of work, with an optional K, M or G suffix (1M)\n"
+                     "  -d      --- the dispatcher only hands out chunks, without counting any while the workers are busy\n"
+                     "  -f num  --- number of files chunks are cut from at once, largest first (2)\n"
+                     "  -h      --- print this help\n"
+                     "  -l name --- language profile with the vowels, separators and joining marks\n"
+                     "  -m list --- also compute, in the same pass, the metrics of the list, separated by commas: letters,\n"
+                     "              bigrams, sentences and consonants, or all\n"
+                     "  -o num  --- number of chunks handed to each worker ahead of its results (2)\n"
+                     "  -p prec --- read random byte ranges of each file until the 95%% confidence intervals of the\n"
+                     "              percentages of the word lengths are within prec percentage points, and print estimates;\n"
+                     "              the workers read the ranges with pread, unless -r says otherwise\n"
+                     "  -q num  --- number of chunks read ahead of the ones handed to the workers (4)\n"
+                     "  -r how  --- the workers read the files themselves, through mpiio or pread\n"
+                     "  -s      --- print the occupancy of the ring of chunks read ahead\n"
+                     "  -t num  --- number of threads of each worker, sharing each chunk it receives (1)\n"
+                     "  -v name --- count every word, each process writing its share of the words, sorted, to name.rank\n"
+                     "  -w      --- hand the chunks to the workers on the node of the dispatcher through shared memory\n"
+                     "  Files compressed with gzip or zstd are decompressed on the fly. With -r, only zstd files whose\n"
+                     "  frames record their size can be read, each frame being decompressed by the worker reading it.\n"
+                     "  The filename - reads the standard input, and it and any pipe are counted as their data arrives.\n",
+             cmdName);
 }
 
 
@@ -198,8 +1139,12 @@ int main(int argc, char **argv) {
     int world_size;
 
     char **filenames;
+    // status of the program, set by the dispatcher
+    int result = EXIT_SUCCESS;
 
-    MPI_Init(&argc, &argv);
+    // only the main thread of the dispatcher calls MPI, its reader thread does not
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
     MPI_Comm_size(MPI_COMM_WORLD, &world_size);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
@@ -209,17 +1154,41 @@ int main(int argc, char **argv) {
         // allocate memory for the filenames of the files to be processed
         filenames = malloc((argc - 1) * sizeof(char *));
 
-        // process the command and act according to it
+        // process the command and build the character classification tables according to it
         int command_result = process_command(argc, argv, filenames);
+        if (command_result == EXIT_SUCCESS) {
+            if (profileName != NULL) {
+                if (!load_classifier(profileName))
+                    command_result = EXIT_FAILURE;
+            } else
+                init_classifier();
+        }
+
+        // a transition table without states tells the workers to leave
         if (command_result != EXIT_SUCCESS)
+            num_states = 0;
+        share_classifier(rank);
+
+        if (command_result != EXIT_SUCCESS) {
+            MPI_Finalize();
             return command_result;
+        }
+        share_work_settings(rank, &filenames);
+        share_chunk_window(rank);
+        set_chunk_size(chunkSize);
+        set_open_files(numOpenFiles);
 
         // launch dispatcher
-        dispatcher(filenames, argc - 1);
+        result = dispatcher(filenames, numFiles);
     } else {
-        worker(rank);
+        share_classifier(rank);
+        if (num_states > 0) {
+            share_work_settings(rank, &filenames);
+            share_chunk_window(rank);
+            worker(rank);
+        }
     }
     MPI_Finalize();
-    return 0;
+    return result;
 }
 
@@ -0,0 +1,152 @@
+/**
+ *  \file rangeReader.c
+ *
+ *  \brief Problem: Frequency of word lengths and the number of vowels
+ *
+ *  Implements the reading of byte ranges of the input files by the workers, through MPI-IO or pread. The file of the
+ *  last range read stays open, as consecutive ranges given to a worker usually belong to the same file. A zstd file
+ *  is read through the index of its frames instead, its ranges being offsets in the decompressed file.
+ *
+ *  \author Rafael Direito - June 2020
+ */
+
+#include <mpi.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "rangeReader.h"
+#include "compressedInput.h"
+
+/** \brief names of the input files. */
+static char **range_filenames;
+
+/** \brief how the files are read, READ_MPIIO or READ_PREAD. */
+static int range_method;
+
+/** \brief index of the open file, -1 if there is none. */
+static int open_file_idx = -1;
+
+/** \brief open file, when it is read through MPI-IO. */
+static MPI_File range_mpi_file;
+
+/** \brief descriptor of the open file, when it is read with pread. */
+static int range_fd = -1;
+
+/** \brief frames of the open file, when it is a zstd file. */
+static FrameIndex range_frames;
+
+/**
+ * \brief Set the files the byte ranges refer to, and how to read them.
+ *
+ * @param filenames names of the input files, indexed as the fileIndex of the ranges
+ * @param method READ_MPIIO or READ_PREAD
+ */
+void set_range_files(char **filenames, int method) {
+    range_filenames = filenames;
+    range_method = method;
+}
+
+/**
+ * \brief Close the input file opened by read_range, if any.
+ */
+void close_range_file() {
+    if (open_file_idx < 0)
+        return;
+
+    if (range_frames.map != NULL)
+        frame_index_close(&range_frames);
+    else if (range_method == READ_MPIIO)
+        MPI_File_close(&range_mpi_file);
+    else
+        close(range_fd);
+    open_file_idx = -1;
+}
+
+/**
+ * \brief Open an input file, unless it is already open.
+ *
+ * @param fileIndex index of the file
+ * @return 1 if the file is open, 0 otherwise.
+ */
+static int open_range_file(int fileIndex) {
+    if (fileIndex == open_file_idx)
+        return 1;
+
+    close_range_file();
+
+    if (input_compression(range_filenames[fileIndex]) == COMPRESSION_ZSTD) {
+        if (!frame_index_open(range_filenames[fileIndex], &range_frames))
+            return 0;
+    } else if (range_method == READ_MPIIO) {
+        if (MPI_File_open(MPI_COMM_SELF, range_filenames[fileIndex], MPI_MODE_RDONLY, MPI_INFO_NULL,
+                          &range_mpi_file) != MPI_SUCCESS)
+            return 0;
+    } else {
+        range_fd = open(range_filenames[fileIndex], O_RDONLY);
+        if (range_fd < 0)
+            return 0;
+    }
+
+    open_file_idx = fileIndex;
+    return 1;
+}
+
+/**
+ * \brief Read bytes of an input file, at a given offset.
+ *
+ * @param fileIndex index of the file
+ * @param offset offset of the first byte to read, in the decompressed file for a zstd file
+ * @param buffer buffer where the bytes are stored
+ * @param length number of bytes to read
+ * @return number of bytes read, less than length only at the end of the file, or -1 if the file could not be read.
+ */
+long read_range(int fileIndex, long offset, unsigned char *buffer, size_t length) {
+    size_t done = 0;
+
+    if (!open_range_file(fileIndex)) {
+        fprintf(stderr, "ERROR: Unable to open the file: %s\n", range_filenames[fileIndex]);
+        return -1;
+    }
+
+    if (range_frames.map != NULL) {
+        long n = frame_index_read(&range_frames, offset, buffer, length);
+
+        if (n < 0)
+            fprintf(stderr, "ERROR: Unable to decompress the file: %s\n", range_filenames[fileIndex]);
+        return n;
+    }
+
+    while (done < length) {
+        size_t piece = length - done > INT_MAX ? INT_MAX : length - done;
+        long n;
+
+        if (range_method == READ_MPIIO) {
+            MPI_Status status;
+            int count;
+
+            if (MPI_File_read_at(range_mpi_file, (MPI_Offset) (offset + done), buffer + done, (int) piece, MPI_BYTE,
+                                 &status) != MPI_SUCCESS)
+                n = -1;
+            else {
+                MPI_Get_count(&status, MPI_BYTE, &count);
+                n = count;
+            }
+        } else {
+            n = pread(range_fd, buffer + done, piece, offset + done);
+            if (n < 0 && errno == EINTR)
+                continue;
+        }
+
+        if (n < 0) {
+            fprintf(stderr, "ERROR: Unable to read the file: %s\n", range_filenames[fileIndex]);
+            return -1;
+        }
+        if (n == 0)
+            break;
+        done += n;
+    }
+
+    return (long) done;
+}
@@ -0,0 +1,30 @@
+/**
+ *  \file rangeReader.h (header file)
+ *
+ *  \brief Problem: Frequency of word lengths and the number of vowels
+ *
+ *  Range reader header file: byte ranges of the input files read by the workers themselves
+ *
+ *  \author Rafael Direito - June 2020
+ */
+
+#include <stddef.h>
+
+#ifndef RANGEREADER_H_
+#define RANGEREADER_H_
+
+/* Ways the input files can be read */
+#define READ_MESSAGES       0   /* the dispatcher reads the files and sends the chunks to the workers */
+#define READ_MPIIO          1   /* the workers read their byte ranges through MPI-IO */
+#define READ_PREAD          2   /* the workers read their byte ranges with pread, from a shared file system */
+
+/** \brief Set the files the byte ranges refer to, and how to read them. */
+extern void set_range_files(char **filenames, int method);
+
+/** \brief Read bytes of an input file, at a given offset. */
+extern long read_range(int fileIndex, long offset, unsigned char *buffer, size_t length);
+
+/** \brief Close the input file opened by read_range, if any. */
+extern void close_range_file();
+
+#endif
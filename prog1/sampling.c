@@ -0,0 +1,374 @@
+/**
+ *  \file sampling.c
+ *
+ *  \brief Problem: Frequency of word lengths and the number of vowels
+ *
+ *  Implements the sampling of the files: instead of reading a file whole, byte ranges of chunk_size bytes are read
+ *  from it at random until the counts of the ranges read estimate the ones of the whole file precisely enough.
+ *
+ *  Each file is split into SAMPLE_STRATA strata of consecutive ranges, and the ranges are read in rounds of one range
+ *  of each stratum, taken at random among the ones of the stratum not read yet, so every part of the file is sampled
+ *  evenly. The words of the ranges give ratio estimators: the share of the words of each length is the words of that
+ *  length over the words of the ranges read, and the number of words of the file is the words per byte of the ranges
+ *  read times its size. Their variances, over ranges drawn without replacement, come from the sums of the counts of the
+ *  ranges, their squares and their products; ignoring the strata, they are slightly larger than the true ones, so the
+ *  95% confidence intervals they give are on the safe side. A file stops being sampled once every interval of the
+ *  percentages of its word lengths is within sample_precision, after SAMPLE_MIN_ROUNDS rounds at least, or once all of
+ *  its ranges were read, when the estimates are exact.
+ *
+ *  The ranges are handed out by the reader thread of the dispatcher and their counts added by its main thread, so the
+ *  state of the files is kept under a lock.
+ *
+ *  \author Rafael Direito - June 2020
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "probConst.h"
+#include "controlInfo.h"
+#include "wordstats.h"
+#include "sampling.h"
+
+/** \brief quantile of the normal distribution of the 95% confidence intervals. */
+#define CONFIDENCE_Z        1.96
+
+/** \brief Sample of a file: the order its ranges are read in, and the sums of the counts of the ranges read. */
+typedef struct {
+    long size;                      /* size of the file */
+    int num_ranges;                 /* number of ranges of chunk_size bytes the file is cut in */
+    int *order;                     /* ranges in the order they are read, NULL until the file is planned */
+    int num_handed;                 /* number of ranges handed out */
+    bool is_done;                   /* flag that indicates that no more ranges of the file are needed */
+    int num_samples;                /* number of ranges whose counts were added */
+    double bytes, bytes_squared;    /* sums of the sizes of the ranges, and of their squares */
+    double words, words_squared;    /* sums of the words of the ranges, and of their squares */
+    double words_bytes;             /* sum of the words of the ranges times their sizes */
+    int num_lengths;                /* number of word lengths of the sums below */
+    double *length_words;           /* sums of the words of each length of the ranges */
+    double *length_squared;         /* sums of the squares of the words of each length of the ranges */
+    double *length_cross;           /* sums of the words of each length of the ranges times the words of the ranges */
+} FileSample;
+
+/** \brief Half-width of the 95% confidence intervals of the percentages of the word lengths, in percentage points,
+ * at which the sampling of a file stops; 0 if the files are read whole. */
+double sample_precision = 0.0;
+
+/** \brief sample of each file. */
+static FileSample *samples = NULL;
+
+/** \brief number of files sampled. */
+static int num_samples = 0;
+
+/** \brief state of the generator of the random order of the ranges. */
+static unsigned long long random_state;
+
+/** \brief lock of the samples, shared by the reader of the ranges and the thread that adds their counts. */
+static pthread_mutex_t sample_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * \brief Next random number, by splitmix64.
+ *
+ * @return the number.
+ */
+static unsigned long long next_random() {
+    unsigned long long z = (random_state += 0x9E3779B97F4A7C15ULL);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * \brief Start sampling a number of files, none of them planned yet.
+ *
+ * @param numFiles number of files
+ * @return 1 if the samples were allocated, 0 otherwise.
+ */
+int sampling_start(int numFiles) {
+    samples = calloc(numFiles, sizeof(FileSample));
+    if (samples == NULL) {
+        fprintf(stderr, "ERROR: Unable to sample the files\n");
+        return 0;
+    }
+
+    num_samples = numFiles;
+    random_state = (unsigned long long) time(NULL);
+    return 1;
+}
+
+/**
+ * \brief Plan the order in which the ranges of a file are sampled: in rounds of one range of each stratum, at random
+ * within each stratum.
+ *
+ * @param fileIndex index of the file
+ * @param size size of the file
+ * @param chunkSize number of bytes of each range
+ * @return 1 if the file was planned, 0 otherwise.
+ */
+int sampling_plan(int fileIndex, long size, int chunkSize) {
+    FileSample *sample = &samples[fileIndex];
+    int numRanges = (int) ((size + chunkSize - 1) / chunkSize);
+    int numStrata = numRanges < SAMPLE_STRATA ? numRanges : SAMPLE_STRATA;
+    // ranges of the file, shuffled within each stratum, and then dealt into the rounds
+    int *ranges = malloc((numRanges + 1) * sizeof(int));
+    int *order = malloc((numRanges + 1) * sizeof(int));
+    int numPlaced = 0;
+
+    if (ranges == NULL || order == NULL) {
+        fprintf(stderr, "ERROR: Unable to sample the file %d\n", fileIndex);
+        free(ranges);
+        free(order);
+        return 0;
+    }
+
+    pthread_mutex_lock(&sample_lock);
+    for (int i = 0; i < numRanges; i++)
+        ranges[i] = i;
+
+    for (int s = 0; s < numStrata; s++) {
+        int first = (int) ((long) s * numRanges / numStrata), last = (int) ((long) (s + 1) * numRanges / numStrata);
+
+        for (int i = last - 1; i > first; i--) {
+            int j = first + (int) (next_random() % (unsigned long long) (i - first + 1));
+            int range = ranges[i];
+
+            ranges[i] = ranges[j];
+            ranges[j] = range;
+        }
+    }
+
+    // the strata differ by one range at most, so every round but the last takes a range of each
+    for (int round = 0; numPlaced < numRanges; round++)
+        for (int s = 0; s < numStrata; s++) {
+            int first = (int) ((long) s * numRanges / numStrata), last = (int) ((long) (s + 1) * numRanges / numStrata);
+
+            if (first + round < last)
+                order[numPlaced++] = ranges[first + round];
+        }
+
+    sample->size = size;
+    sample->num_ranges = numRanges;
+    sample->order = order;
+    sample->is_done = numRanges == 0;
+    pthread_mutex_unlock(&sample_lock);
+
+    free(ranges);
+    return 1;
+}
+
+/**
+ * \brief Offset of the next range of a file to be sampled.
+ *
+ * @param fileIndex index of the file, planned by sampling_plan
+ * @param chunkSize number of bytes of each range
+ * @return the offset, or -1 if the estimates of the file are precise enough or all of its ranges were handed out.
+ */
+long sampling_next(int fileIndex, int chunkSize) {
+    FileSample *sample = &samples[fileIndex];
+    long offset = -1;
+
+    pthread_mutex_lock(&sample_lock);
+    if (sample->order != NULL && !sample->is_done && sample->num_handed < sample->num_ranges)
+        offset = (long) sample->order[sample->num_handed++] * chunkSize;
+    pthread_mutex_unlock(&sample_lock);
+
+    return offset;
+}
+
+/**
+ * \brief Fraction of the ranges of a file that were sampled, without the lock.
+ *
+ * @param sample sample of the file
+ * @return the fraction, 1 for an empty file.
+ */
+static double sampled_fraction(const FileSample *sample) {
+    return sample->num_ranges > 0 ? (double) sample->num_samples / sample->num_ranges : 1.0;
+}
+
+/**
+ * \brief Half-width of the confidence interval of the share of the words of a file with a length, without the lock.
+ *
+ * @param sample sample of the file
+ * @param length length of the words, from 1
+ * @return the half-width, as a share of the words; infinite while there are not enough ranges to tell.
+ */
+static double share_half_width(const FileSample *sample, int length) {
+    double f = sampled_fraction(sample), k = sample->num_samples, share, spread;
+    double y, yy, yn;
+
+    if (f >= 1.0 || length > sample->num_lengths || sample->words == 0.0)
+        return 0.0;
+    if (k < 2)
+        return HUGE_VAL;
+
+    y = sample->length_words[length - 1];
+    yy = sample->length_squared[length - 1];
+    yn = sample->length_cross[length - 1];
+    share = y / sample->words;
+
+    // sum of the squares of the differences between the words of the length and the share of the words of the ranges
+    spread = yy - 2 * share * yn + share * share * sample->words_squared;
+    if (spread < 0)
+        spread = 0;
+
+    return CONFIDENCE_Z * sqrt((1 - f) * spread / (k * (k - 1))) / (sample->words / k);
+}
+
+/**
+ * \brief Check if the confidence intervals of the percentages of every word length of a file are within the target
+ * precision, without the lock.
+ *
+ * @param sample sample of the file
+ * @return true if they are, false otherwise.
+ */
+static bool is_precise(const FileSample *sample) {
+    int numStrata = sample->num_ranges < SAMPLE_STRATA ? sample->num_ranges : SAMPLE_STRATA;
+
+    if (sample->num_samples < SAMPLE_MIN_ROUNDS * numStrata && sample->num_samples < sample->num_ranges)
+        return false;
+
+    for (int length = 1; length <= sample->num_lengths; length++)
+        if (100 * share_half_width(sample, length) > sample_precision)
+            return false;
+
+    return true;
+}
+
+/**
+ * \brief Make room in the sums of a file for the words of a number of lengths.
+ *
+ * @param sample sample of the file
+ * @param numLengths number of lengths
+ * @return 1 if there is room, 0 otherwise.
+ */
+static int reserve_lengths(FileSample *sample, int numLengths) {
+    double **sums[3] = {&sample->length_words, &sample->length_squared, &sample->length_cross};
+
+    if (numLengths <= sample->num_lengths)
+        return 1;
+
+    for (int i = 0; i < 3; i++) {
+        double *grown = realloc(*sums[i], numLengths * sizeof(double));
+
+        if (grown == NULL)
+            return 0;
+        memset(grown + sample->num_lengths, 0, (numLengths - sample->num_lengths) * sizeof(double));
+        *sums[i] = grown;
+    }
+
+    sample->num_lengths = numLengths;
+    return 1;
+}
+
+/**
+ * \brief Add the counts of a sampled range to the sums of its file, and stop sampling the file once its estimates are
+ * precise enough.
+ *
+ * @param fileIndex index of the file
+ * @param length number of bytes of the range
+ * @param counts counts of the words of the range
+ */
+void sampling_add(int fileIndex, int length, const WordCounts *counts) {
+    FileSample *sample = &samples[fileIndex];
+    int *lengths = malloc((counts->max_word_length + 1) * sizeof(int));
+    double n = counts->num_words_read;
+
+    pthread_mutex_lock(&sample_lock);
+    if (lengths == NULL || !reserve_lengths(sample, counts->max_word_length)) {
+        pthread_mutex_unlock(&sample_lock);
+        fprintf(stderr, "ERROR: Unable to add a range to the sample of the file %d\n", fileIndex);
+        free(lengths);
+        return;
+    }
+    wordstats_length_counts(counts, lengths, counts->max_word_length);
+
+    sample->num_samples++;
+    sample->bytes += length;
+    sample->bytes_squared += (double) length * length;
+    sample->words += n;
+    sample->words_squared += n * n;
+    sample->words_bytes += n * length;
+    for (int i = 0; i < counts->max_word_length; i++) {
+        sample->length_words[i] += lengths[i];
+        sample->length_squared[i] += (double) lengths[i] * lengths[i];
+        sample->length_cross[i] += lengths[i] * n;
+    }
+
+    if (!sample->is_done)
+        sample->is_done = is_precise(sample);
+    pthread_mutex_unlock(&sample_lock);
+
+    free(lengths);
+}
+
+/**
+ * \brief Fraction of the bytes of a file that were sampled.
+ *
+ * @param fileIndex index of the file
+ * @return the fraction, 1 for an empty file.
+ */
+double sampling_fraction(int fileIndex) {
+    FileSample *sample = &samples[fileIndex];
+
+    return sample->size > 0 ? sample->bytes / sample->size : 1.0;
+}
+
+/**
+ * \brief Estimate the number of words of a file, from the words per byte of the ranges read.
+ *
+ * @param fileIndex index of the file
+ * @param halfWidth set to the half-width of the 95% confidence interval of the estimate
+ * @return the estimate.
+ */
+double sampling_total_words(int fileIndex, double *halfWidth) {
+    FileSample *sample = &samples[fileIndex];
+    double f = sampled_fraction(sample), k = sample->num_samples, ratio, spread;
+
+    *halfWidth = 0.0;
+    if (sample->bytes == 0.0)
+        return 0.0;
+
+    ratio = sample->words / sample->bytes;
+    if (f < 1.0) {
+        // sum of the squares of the differences between the words of the ranges and the words per byte of the file
+        spread = sample->words_squared - 2 * ratio * sample->words_bytes + ratio * ratio * sample->bytes_squared;
+        if (spread < 0)
+            spread = 0;
+        *halfWidth = k < 2 ? HUGE_VAL
+                           : CONFIDENCE_Z * sqrt((1 - f) * spread / (k * (k - 1))) / (sample->bytes / k) * sample->size;
+    }
+
+    return ratio * sample->size;
+}
+
+/**
+ * \brief Half-width of the 95% confidence interval of the percentage of the words of a file with a length.
+ *
+ * @param fileIndex index of the file
+ * @param length length of the words, from 1
+ * @return the half-width, in percentage points.
+ */
+double sampling_half_width(int fileIndex, int length) {
+    return 100 * share_half_width(&samples[fileIndex], length);
+}
+
+/**
+ * \brief Free the plans and the estimates of the files.
+ */
+void sampling_stop() {
+    for (int fi = 0; fi < num_samples; fi++) {
+        free(samples[fi].order);
+        free(samples[fi].length_words);
+        free(samples[fi].length_squared);
+        free(samples[fi].length_cross);
+    }
+
+    free(samples);
+    samples = NULL;
+    num_samples = 0;
+}
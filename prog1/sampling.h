@@ -0,0 +1,44 @@
+/**
+ *  \file sampling.h (header file)
+ *
+ *  \brief Problem: Frequency of word lengths and the number of vowels
+ *
+ *  Sampling header file: estimates of the counts from a random, stratified sample of the byte ranges of each file
+ *
+ *  \author Rafael Direito - June 2020
+ */
+
+#include "controlInfo.h"
+
+#ifndef SAMPLING_H_
+#define SAMPLING_H_
+
+/** \brief Half-width of the 95% confidence intervals of the percentages of the word lengths, in percentage points,
+ * at which the sampling of a file stops; 0 if the files are read whole. */
+extern double sample_precision;
+
+/** \brief Start sampling a number of files. */
+extern int sampling_start(int numFiles);
+
+/** \brief Plan the order in which the ranges of a file are sampled. */
+extern int sampling_plan(int fileIndex, long size, int chunkSize);
+
+/** \brief Offset of the next range of a file to be sampled. */
+extern long sampling_next(int fileIndex, int chunkSize);
+
+/** \brief Add the counts of a sampled range to the estimates of its file. */
+extern void sampling_add(int fileIndex, int length, const WordCounts *counts);
+
+/** \brief Fraction of the bytes of a file that were sampled. */
+extern double sampling_fraction(int fileIndex);
+
+/** \brief Estimate the number of words of a file. */
+extern double sampling_total_words(int fileIndex, double *halfWidth);
+
+/** \brief Half-width of the confidence interval of the percentage of the words of a file with a length. */
+extern double sampling_half_width(int fileIndex, int length);
+
+/** \brief Free the plans and the estimates of the files. */
+extern void sampling_stop();
+
+#endif
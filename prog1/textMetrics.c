@@ -0,0 +1,423 @@
+/**
+ *  \file textMetrics.c
+ *
+ *  \brief Problem: Frequency of word lengths and the number of vowels
+ *
+ *  Implements the text metrics that can be computed in the same pass as the word counts: the frequency of each letter,
+ *  the frequency of each pair of consecutive letters of a word (character bigrams), the length of the sentences in
+ *  words and the number of consonants of the words.
+ *
+ *  Each metric keeps its counts in its own accumulator of WordCounts, a hash table from its keys (code points, pairs of
+ *  code points, or numbers of words or consonants) to their counts, so the metrics are merged, sent and received with
+ *  the word counts, whichever metrics are selected. The accumulators are filled by metrics_kernel, which runs the state
+ *  machine once for the words and every metric.
+ *
+ *  \author Rafael Direito - June 2020
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "controlInfo.h"
+#include "textMetrics.h"
+
+/** \brief number of entries printed on each line. */
+#define ENTRIES_PER_LINE    4
+
+/** \brief number of entries of the histograms printed on each line. */
+#define HISTOGRAM_PER_LINE  8
+
+/** \brief Description of a metric: how it is selected and how it is printed. */
+typedef struct {
+    const char *name;
+    void (*print)(const MetricTable *table);
+} MetricInfo;
+
+/** \brief Metrics selected, one bit per metric. */
+int text_metrics = 0;
+
+static void print_letters(const MetricTable *table);
+static void print_bigrams(const MetricTable *table);
+static void print_sentences(const MetricTable *table);
+static void print_consonants(const MetricTable *table);
+
+/** \brief every metric, at its position in the metrics of WordCounts. */
+static const MetricInfo metric_info[NUM_METRICS] = {
+        [METRIC_LETTERS] = {"letters", print_letters},
+        [METRIC_BIGRAMS] = {"bigrams", print_bigrams},
+        [METRIC_SENTENCES] = {"sentences", print_sentences},
+        [METRIC_CONSONANTS] = {"consonants", print_consonants},
+};
+
+/**
+ * \brief Select the metrics to compute, given a list of their names.
+ *
+ * @param names names of the metrics, separated by commas, or "all"
+ * @return 1 if every name is known, 0 otherwise.
+ */
+int metrics_select(const char *names) {
+    int selected = 0;
+
+    while (*names != '\0') {
+        size_t length = strcspn(names, ",");
+        int metric;
+
+        if (length == 3 && strncmp(names, "all", 3) == 0)
+            selected |= METRIC_BIT(NUM_METRICS) - 1;
+        else {
+            for (metric = 0; metric < NUM_METRICS; metric++)
+                if (strlen(metric_info[metric].name) == length && strncmp(names, metric_info[metric].name, length) == 0)
+                    break;
+            if (metric == NUM_METRICS)
+                return 0;
+            selected |= METRIC_BIT(metric);
+        }
+
+        names += length;
+        if (*names == ',')
+            names++;
+    }
+
+    text_metrics = selected;
+    return 1;
+}
+
+/**
+ * \brief Find the entry of a key of an accumulator, or the free entry where it goes.
+ *
+ * @param table accumulator with entries
+ * @param key key
+ * @return the entry.
+ */
+static MetricCount *find_entry(const MetricTable *table, long long key) {
+    unsigned int mask = table->size - 1;
+    unsigned int i = (unsigned int) (((unsigned long long) key * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+
+    while (table->entries[i].count != 0 && table->entries[i].key != key)
+        i = (i + 1) & mask;
+
+    return &table->entries[i];
+}
+
+/**
+ * \brief Double the size of an accumulator, keeping it at most half full.
+ *
+ * @param table accumulator
+ * @return 1 if the accumulator grew, 0 otherwise.
+ */
+static int grow_table(MetricTable *table) {
+    MetricTable grown = *table;
+
+    grown.size = table->size > 0 ? 2 * table->size : 64;
+    grown.entries = calloc(grown.size, sizeof(MetricCount));
+    if (grown.entries == NULL)
+        return 0;
+
+    for (int i = 0; i < table->size; i++)
+        if (table->entries[i].count != 0)
+            *find_entry(&grown, table->entries[i].key) = table->entries[i];
+
+    free(table->entries);
+    table->entries = grown.entries;
+    table->size = grown.size;
+    return 1;
+}
+
+/**
+ * \brief Add to the count of a key of a metric.
+ *
+ * @param table accumulator of the metric
+ * @param key key
+ * @param count number to add
+ */
+void metric_table_add(MetricTable *table, long long key, long long count) {
+    MetricCount *entry;
+
+    if (2 * (table->num_entries + 1) > table->size && !grow_table(table) && table->num_entries == table->size) {
+        fprintf(stderr, "ERROR: Unable to count the key %lld of a metric\n", key);
+        return;
+    }
+
+    entry = find_entry(table, key);
+    if (entry->count == 0) {
+        entry->key = key;
+        table->num_entries++;
+    }
+    entry->count += count;
+}
+
+/**
+ * \brief Add the counts of an accumulator to another one.
+ *
+ * @param table accumulator to add to
+ * @param other accumulator to add
+ */
+void metric_table_merge(MetricTable *table, const MetricTable *other) {
+    for (int i = 0; i < other->size; i++)
+        if (other->entries[i].count != 0)
+            metric_table_add(table, other->entries[i].key, other->entries[i].count);
+}
+
+/**
+ * \brief Free the entries of an accumulator, which is left empty.
+ *
+ * @param table accumulator
+ */
+void metric_table_free(MetricTable *table) {
+    free(table->entries);
+    memset(table, 0, sizeof *table);
+}
+
+/**
+ * \brief Number of ints of the encoding of an accumulator.
+ *
+ * @param table accumulator
+ * @return the number of ints written by metric_table_encode.
+ */
+int metric_table_encoded_size(const MetricTable *table) {
+    return 1 + 4 * table->num_entries;
+}
+
+/**
+ * \brief Encode an accumulator: the number of entries, then the upper and lower halves of the key and of the count of
+ * each entry.
+ *
+ * @param table accumulator
+ * @param buffer where the encoding is written, with room for metric_table_encoded_size ints
+ * @return the number of ints written.
+ */
+int metric_table_encode(const MetricTable *table, int *buffer) {
+    int size = 1;
+
+    buffer[0] = table->num_entries;
+    for (int i = 0; i < table->size; i++)
+        if (table->entries[i].count != 0) {
+            buffer[size++] = (int) (table->entries[i].key >> 32);
+            buffer[size++] = (int) (unsigned int) table->entries[i].key;
+            buffer[size++] = (int) (table->entries[i].count >> 32);
+            buffer[size++] = (int) (unsigned int) table->entries[i].count;
+        }
+
+    return size;
+}
+
+/**
+ * \brief Add an accumulator encoded by metric_table_encode to another one.
+ *
+ * @param table accumulator to add to
+ * @param buffer encoded accumulator to add
+ * @return the number of ints read.
+ */
+int metric_table_decode(MetricTable *table, const int *buffer) {
+    const int *entry = buffer + 1;
+
+    for (int i = 0; i < buffer[0]; i++, entry += 4)
+        metric_table_add(table, ((long long) entry[0] << 32) | (unsigned int) entry[1],
+                         ((long long) entry[2] << 32) | (unsigned int) entry[3]);
+
+    return 1 + 4 * buffer[0];
+}
+
+/**
+ * \brief Order entries by decreasing count, and by increasing key for the same count.
+ */
+static int by_count(const void *a, const void *b) {
+    const MetricCount *x = a, *y = b;
+
+    if (x->count != y->count)
+        return x->count < y->count ? 1 : -1;
+    return (x->key > y->key) - (x->key < y->key);
+}
+
+/**
+ * \brief Order entries by increasing key.
+ */
+static int by_key(const void *a, const void *b) {
+    const MetricCount *x = a, *y = b;
+
+    return (x->key > y->key) - (x->key < y->key);
+}
+
+/**
+ * \brief Copy the entries in use of an accumulator, sorted.
+ *
+ * @param table accumulator
+ * @param compare order of the entries
+ * @param total where the sum of the counts is stored
+ * @return the entries, to be freed by the caller, or NULL if the accumulator is empty or there is no memory.
+ */
+static MetricCount *sorted_entries(const MetricTable *table, int (*compare)(const void *, const void *),
+                                   long long *total) {
+    MetricCount *entries;
+    int n = 0;
+
+    *total = 0;
+    if (table->num_entries == 0)
+        return NULL;
+
+    entries = malloc(table->num_entries * sizeof(MetricCount));
+    if (entries == NULL) {
+        printf("ERROR: Unable to print a metric\n");
+        return NULL;
+    }
+
+    for (int i = 0; i < table->size; i++)
+        if (table->entries[i].count != 0) {
+            entries[n++] = table->entries[i];
+            *total += table->entries[i].count;
+        }
+
+    qsort(entries, n, sizeof(MetricCount), compare);
+    return entries;
+}
+
+/**
+ * \brief Write the UTF-8 encoding of a code point.
+ *
+ * @param codePoint code point
+ * @param text where the encoding is written, with room for 4 bytes
+ * @return the number of bytes written.
+ */
+int encode_utf8(int codePoint, char *text) {
+    if (codePoint < 0x80) {
+        text[0] = (char) codePoint;
+        return 1;
+    }
+    if (codePoint < 0x800) {
+        text[0] = (char) (0xC0 | (codePoint >> 6));
+        text[1] = (char) (0x80 | (codePoint & 0x3F));
+        return 2;
+    }
+    if (codePoint < 0x10000) {
+        text[0] = (char) (0xE0 | (codePoint >> 12));
+        text[1] = (char) (0x80 | ((codePoint >> 6) & 0x3F));
+        text[2] = (char) (0x80 | (codePoint & 0x3F));
+        return 3;
+    }
+    text[0] = (char) (0xF0 | ((codePoint >> 18) & 0x07));
+    text[1] = (char) (0x80 | ((codePoint >> 12) & 0x3F));
+    text[2] = (char) (0x80 | ((codePoint >> 6) & 0x3F));
+    text[3] = (char) (0x80 | (codePoint & 0x3F));
+    return 4;
+}
+
+/**
+ * \brief Print the entries of the letters or the bigrams, the most frequent first, ENTRIES_PER_LINE per line.
+ *
+ * @param table accumulator with code points, or pairs of code points, as keys
+ * @param numCodePoints number of code points of each key, 1 or 2
+ * @param title name of the counted units
+ */
+static void print_frequencies(const MetricTable *table, int numCodePoints, const char *title) {
+    long long total;
+    MetricCount *entries = sorted_entries(table, by_count, &total);
+    char text[8];
+    int length;
+
+    printf("%s = %lld; distinct = %d;\n", title, total, table->num_entries);
+    if (entries == NULL) {
+        printf("\n");
+        return;
+    }
+
+    for (int i = 0; i < table->num_entries; i++) {
+        if (numCodePoints == 2) {
+            length = encode_utf8((int) (entries[i].key >> BIGRAM_SHIFT), text);
+            length += encode_utf8((int) (entries[i].key & ((1 << BIGRAM_SHIFT) - 1)), text + length);
+        } else
+            length = encode_utf8((int) entries[i].key, text);
+
+        // each code point takes a column, whatever the length of its encoding
+        printf("%*s%.*s", 4 - numCodePoints, "", length, text);
+        printf("%10lld%7.2f%%", entries[i].count, (double) entries[i].count / total * 100);
+        if ((i + 1) % ENTRIES_PER_LINE == 0 || i + 1 == table->num_entries)
+            printf("\n");
+    }
+    printf("\n");
+    free(entries);
+}
+
+/**
+ * \brief Print a histogram, by increasing key, HISTOGRAM_PER_LINE entries per line.
+ *
+ * @param entries entries sorted by key
+ * @param n number of entries
+ */
+static void print_histogram(const MetricCount *entries, int n) {
+    for (int i = 0; i < n; i++) {
+        printf("%6lld:%9lld", entries[i].key, entries[i].count);
+        if ((i + 1) % HISTOGRAM_PER_LINE == 0 || i + 1 == n)
+            printf("\n");
+    }
+    printf("\n");
+}
+
+/**
+ * \brief Print the frequency of each letter.
+ *
+ * @param table accumulator of the letters
+ */
+static void print_letters(const MetricTable *table) {
+    print_frequencies(table, 1, "Letters");
+}
+
+/**
+ * \brief Print the frequency of each pair of consecutive letters of a word.
+ *
+ * @param table accumulator of the bigrams
+ */
+static void print_bigrams(const MetricTable *table) {
+    print_frequencies(table, 2, "Bigrams");
+}
+
+/**
+ * \brief Print the number of sentences, their mean and largest length in words, and the histogram of their lengths.
+ *
+ * @param table accumulator of the lengths of the sentences
+ */
+static void print_sentences(const MetricTable *table) {
+    long long total, words = 0;
+    MetricCount *entries = sorted_entries(table, by_key, &total);
+
+    for (int i = 0; i < table->num_entries && entries != NULL; i++)
+        words += entries[i].key * entries[i].count;
+
+    printf("Sentences = %lld; mean length = %.2f words; longest = %lld words;\n", total,
+           total > 0 ? (double) words / total : 0.0, entries != NULL ? entries[table->num_entries - 1].key : 0);
+    if (entries != NULL)
+        print_histogram(entries, table->num_entries);
+    else
+        printf("\n");
+    free(entries);
+}
+
+/**
+ * \brief Print the number of consonants, their mean per word, and the histogram of the words by their consonants.
+ *
+ * @param table accumulator of the numbers of consonants of the words
+ */
+static void print_consonants(const MetricTable *table) {
+    long long total, consonants = 0;
+    MetricCount *entries = sorted_entries(table, by_key, &total);
+
+    for (int i = 0; i < table->num_entries && entries != NULL; i++)
+        consonants += entries[i].key * entries[i].count;
+
+    printf("Consonants = %lld; mean per word = %.2f;\n", consonants, total > 0 ? (double) consonants / total : 0.0);
+    if (entries != NULL)
+        print_histogram(entries, table->num_entries);
+    else
+        printf("\n");
+    free(entries);
+}
+
+/**
+ * \brief Print the selected metrics of some counts.
+ *
+ * @param counts counts of a file
+ */
+void metrics_print(const WordCounts *counts) {
+    for (int metric = 0; metric < NUM_METRICS; metric++)
+        if (text_metrics & METRIC_BIT(metric))
+            metric_info[metric].print(&counts->metrics[metric]);
+}
@@ -0,0 +1,58 @@
+/**
+ *  \file textMetrics.h (header file)
+ *
+ *  \brief Problem: Frequency of word lengths and the number of vowels
+ *
+ *  Text metrics header file: statistics computed in the same pass as the word counts
+ *
+ *  \author Rafael Direito - June 2020
+ */
+
+#include "controlInfo.h"
+
+#ifndef TEXTMETRICS_H_
+#define TEXTMETRICS_H_
+
+/* Metrics, by their position in the metrics of WordCounts */
+#define METRIC_LETTERS      0
+#define METRIC_BIGRAMS      1
+#define METRIC_SENTENCES    2
+#define METRIC_CONSONANTS   3
+
+/** \brief bit of a metric in text_metrics. */
+#define METRIC_BIT(metric)  (1 << (metric))
+
+/** \brief bits of the second code point in the key of a bigram, below the first one. */
+#define BIGRAM_SHIFT        21
+
+/** \brief Metrics selected, one bit per metric. */
+extern int text_metrics;
+
+/** \brief Select the metrics to compute, given a list of their names. */
+extern int metrics_select(const char *names);
+
+/** \brief Add to the count of a key of a metric. */
+extern void metric_table_add(MetricTable *table, long long key, long long count);
+
+/** \brief Add the counts of an accumulator to another one. */
+extern void metric_table_merge(MetricTable *table, const MetricTable *other);
+
+/** \brief Free the entries of an accumulator, which is left empty. */
+extern void metric_table_free(MetricTable *table);
+
+/** \brief Number of ints of the encoding of an accumulator. */
+extern int metric_table_encoded_size(const MetricTable *table);
+
+/** \brief Encode an accumulator. */
+extern int metric_table_encode(const MetricTable *table, int *buffer);
+
+/** \brief Add an accumulator encoded by metric_table_encode to another one. */
+extern int metric_table_decode(MetricTable *table, const int *buffer);
+
+/** \brief Write the UTF-8 encoding of a code point. */
+extern int encode_utf8(int codePoint, char *text);
+
+/** \brief Print the selected metrics of some counts. */
+extern void metrics_print(const WordCounts *counts);
+
+#endif
@@ -0,0 +1,605 @@
+/**
+ *  \file tokenKernel.c
+ *
+ *  \brief Problem: Frequency of word lengths and the number of vowels
+ *
+ *  Implements the tokenizer kernels which turn a buffer of bytes into word lengths and vowel counts.
+ *
+ *  The scalar kernel runs blocks made only of bytes that never leave the initial state of the state machine (pure
+ *  ASCII blocks, for instance) through a simpler stateless loop. Besides it, there are SSE4.2, AVX2 and AVX-512
+ *  kernels that classify 16, 32 or 64 bytes at a time into split, letter and vowel masks and walk the split positions
+ *  of the masks to find the words. A vector block is only used when the state machine is in its initial state and
+ *  none of the bytes of the block leaves it (for instance the 0xC3 and 0xE2 prefixes), otherwise the block goes
+ *  through the scalar state machine.
+ *
+ *  \author Rafael Direito - June 2020
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "controlInfo.h"
+#include "tokenKernel.h"
+#include "wordstats.h"
+#include "textMetrics.h"
+#include "vocabulary.h"
+#include "wordSketch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define X86_KERNELS
+#include <immintrin.h>
+#endif
+
+/* Masks computed for each vector block */
+#define MASK_SPLIT          0
+#define MASK_LETTER         1
+#define MASK_VOWEL          2
+#define MASK_ESCAPE         3
+#define NUM_MASKS           4
+
+/** \brief number of bytes of each block of the scalar kernel. */
+#define SCALAR_BLOCK        64
+
+/** \brief largest number of bytes leaving the initial state that the scalar kernel looks for in each block. */
+#define MAX_SWAR_ESCAPES    4
+
+/* Constants of the SWAR (SIMD within a register) tests */
+#define SWAR_ONES           0x0101010101010101ULL
+#define SWAR_HIGHS          0x8080808080808080ULL
+
+/** \brief transition table in use. */
+static const unsigned char (*kernel_transitions)[NUM_BYTES];
+
+/**
+ * \brief lookup tables indexed by the low nibble of a byte. Each entry holds one bit per high nibble value, the first
+ * table for bytes below 0x80 and the second for the remaining ones.
+ */
+static unsigned char nibble_lut[NUM_MASKS][2][16];
+
+/** \brief bit that selects each high nibble value in the entries of nibble_lut. */
+static const unsigned char nibble_bits[16] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+                                              0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80};
+
+/** \brief masks each byte belongs to, one bit per mask. */
+static unsigned char byte_masks[NUM_BYTES];
+
+/** \brief bytes that leave the initial state of the transition table. */
+static unsigned char escape_bytes[MAX_SWAR_ESCAPES];
+
+/** \brief number of bytes that leave the initial state of the transition table. */
+static int num_escape_bytes;
+
+/** \brief flag that indicates that no ASCII byte leaves the initial state of the transition table. */
+static int ascii_stateless;
+
+/** \brief Kernel selected for this CPU. */
+TokenKernel token_kernel;
+
+/** \brief Name of the kernel selected for this CPU. */
+const char *token_kernel_name;
+
+/**
+ * \brief Store a word that was found in the results.
+ *
+ * @param tokenState progress of the tokenizer, holding the word that was just completed
+ * @param counts counts where the words are stored
+ */
+static inline void add_word(TokenState *tokenState, WordCounts *counts) {
+    if (tokenState->word_length > counts->max_word_length)
+        counts->max_word_length = tokenState->word_length;
+
+    if (tokenState->num_vowels > counts->max_num_vowels)
+        counts->max_num_vowels = tokenState->num_vowels;
+
+    if (tokenState->word_length <= WORD_LENGTH) {
+        counts->word_lengths[tokenState->word_length - 1] += 1;
+        counts->word_vowels[tokenState->num_vowels][tokenState->word_length - 1] += 1;
+    } else
+        wordstats_add_long_words(counts, tokenState->word_length, tokenState->num_vowels, 1);
+    counts->num_words_read += 1;
+
+    tokenState->num_vowels = 0;
+    tokenState->word_length = 0;
+}
+
+/**
+ * \brief Run the state machine over a buffer, one byte at a time.
+ *
+ * @param data bytes to process
+ * @param n number of bytes to process
+ * @param tokenState progress of the tokenizer
+ * @param counts counts where the words are stored
+ */
+static void run_state_machine(const unsigned char *data, int n, TokenState *tokenState, WordCounts *counts) {
+    const unsigned char (*transitions)[NUM_BYTES] = kernel_transitions;
+    unsigned char entry;
+    int state = tokenState->state;
+
+    for (int i = 0; i < n; i++) {
+        // Get the transition for the next character.
+        entry = transitions[state][data[i]];
+        state = entry >> 2;
+
+        switch (entry & 3) {
+            case ACTION_VOWEL:
+                tokenState->num_vowels += 1;
+                // fall through
+            case ACTION_LETTER:
+                tokenState->word_length += 1;
+                break;
+            case ACTION_SPLIT:
+                // A character that splits words was found, so we have a new word.
+                if (tokenState->word_length > 0)
+                    add_word(tokenState, counts);
+                break;
+        }
+    }
+    tokenState->state = state;
+}
+
+/**
+ * \brief Store a word that was found in the results, in the accumulators of the selected text metrics, in the
+ * vocabulary and in the sketches of the words.
+ *
+ * @param tokenState progress of the tokenizer, holding the word that was just completed
+ * @param counts counts where the words are stored
+ */
+static void add_metric_word(TokenState *tokenState, WordCounts *counts) {
+    if (text_metrics & METRIC_BIT(METRIC_CONSONANTS))
+        metric_table_add(&counts->metrics[METRIC_CONSONANTS], tokenState->word_length - tokenState->num_vowels, 1);
+
+    if (vocabulary_selected || sketches_selected) {
+        unsigned long long hash = vocabulary_hash(tokenState->word_text, tokenState->word_text_length);
+
+        if (vocabulary_selected)
+            vocabulary_add(&counts->vocabulary, tokenState->word_text, tokenState->word_text_length, hash, 1);
+        if (sketches_selected && counts->sketch == NULL)
+            counts->sketch = sketch_create();
+        if (sketches_selected && counts->sketch != NULL)
+            sketch_add(counts->sketch, tokenState->word_text, tokenState->word_text_length, hash);
+    }
+    tokenState->word_text_length = 0;
+    tokenState->word_text_used = 0;
+
+    tokenState->sentence_words += 1;
+    tokenState->last_letter = 0;
+    add_word(tokenState, counts);
+}
+
+/**
+ * \brief Fold a letter to lower case, for the ASCII and Latin-1 letters.
+ *
+ * @param codePoint code point of the letter
+ * @return the code point of its lower case form.
+ */
+static inline int fold_letter(int codePoint) {
+    if ((codePoint >= 'A' && codePoint <= 'Z') || (codePoint >= 0xC0 && codePoint <= 0xDE && codePoint != 0xD7))
+        return codePoint + 0x20;
+    return codePoint;
+}
+
+/**
+ * \brief Add a code point to the text of the word in progress, unless the text is full.
+ *
+ * @param tokenState progress of the tokenizer
+ * @param codePoint code point
+ */
+static inline void add_word_text(TokenState *tokenState, int codePoint) {
+    if (tokenState->word_text_used + 4 <= MAX_WORD_TEXT)
+        tokenState->word_text_used += encode_utf8(codePoint, tokenState->word_text + tokenState->word_text_used);
+}
+
+/**
+ * \brief Kernel that computes the selected text metrics, the vocabulary and the sketches of the words in the same
+ * pass as the word counts.
+ *
+ * Runs the state machine one byte at a time, as the scalar kernel does for the bytes that leave the initial state,
+ * and decodes the code points of the UTF-8 encoding alongside it. A letter, found on the last byte of its code point,
+ * counts for the letters and, with the letter before it in the same word, for the bigrams. A word counts for the
+ * consonants, those of its letters that are not vowels, and for the sentence in progress, which ends at a '.', '!' or
+ * '?' that splits words. Bytes that are not valid UTF-8 are taken as code points of their own, as letters.
+ *
+ * For the vocabulary and the sketches of the words, the text of the word in progress is kept as well: its letters, and the joiners between them.
+ * The text of a word longer than MAX_WORD_TEXT bytes is cut there.
+ *
+ * @param data bytes to process
+ * @param n number of bytes to process
+ * @param tokenState progress of the tokenizer
+ * @param counts counts where the words and the metrics are stored
+ */
+void metrics_kernel(const unsigned char *data, int n, TokenState *tokenState, WordCounts *counts) {
+    const unsigned char (*transitions)[NUM_BYTES] = kernel_transitions;
+    int metrics = text_metrics;
+    int keepText = vocabulary_selected || sketches_selected;
+    unsigned char entry;
+    int state = tokenState->state;
+    int letter;
+
+    for (int i = 0; i < n; i++) {
+        unsigned char chr = data[i];
+
+        entry = transitions[state][chr];
+        state = entry >> 2;
+
+        // decode the code point the byte belongs to
+        if (chr < 0x80 || chr >= 0xF8 || (chr < 0xC0 && tokenState->utf8_pending == 0)) {
+            tokenState->code_point = chr;
+            tokenState->utf8_pending = 0;
+        } else if (chr < 0xC0) {
+            tokenState->code_point = (tokenState->code_point << 6) | (chr & 0x3F);
+            tokenState->utf8_pending--;
+        } else {
+            tokenState->utf8_pending = chr < 0xE0 ? 1 : chr < 0xF0 ? 2 : 3;
+            tokenState->code_point = chr & (0x3F >> tokenState->utf8_pending);
+        }
+
+        switch (entry & 3) {
+            case ACTION_VOWEL:
+                tokenState->num_vowels += 1;
+                // fall through
+            case ACTION_LETTER:
+                tokenState->word_length += 1;
+                letter = fold_letter(tokenState->code_point);
+                if (metrics & METRIC_BIT(METRIC_LETTERS))
+                    metric_table_add(&counts->metrics[METRIC_LETTERS], letter, 1);
+                if ((metrics & METRIC_BIT(METRIC_BIGRAMS)) && tokenState->last_letter != 0)
+                    metric_table_add(&counts->metrics[METRIC_BIGRAMS],
+                                     ((long long) tokenState->last_letter << BIGRAM_SHIFT) | letter, 1);
+                tokenState->last_letter = letter;
+                if (keepText) {
+                    add_word_text(tokenState, letter);
+                    tokenState->word_text_length = tokenState->word_text_used;
+                }
+                break;
+            case ACTION_SPLIT:
+                // A character that splits words was found, so we have a new word.
+                if (tokenState->word_length > 0)
+                    add_metric_word(tokenState, counts);
+                if ((chr == '.' || chr == '!' || chr == '?') && tokenState->sentence_words > 0) {
+                    if (metrics & METRIC_BIT(METRIC_SENTENCES))
+                        metric_table_add(&counts->metrics[METRIC_SENTENCES], tokenState->sentence_words, 1);
+                    tokenState->sentence_words = 0;
+                }
+                tokenState->word_text_used = 0;
+                break;
+            default:
+                // a joiner inside a word is part of its text
+                if (keepText && tokenState->word_length > 0 && tokenState->utf8_pending == 0)
+                    add_word_text(tokenState, tokenState->code_point);
+                break;
+        }
+    }
+    tokenState->state = state;
+}
+
+/**
+ * \brief Run the actions of the initial state over a block of SCALAR_BLOCK bytes.
+ *
+ * Only valid when the state machine is in its initial state and none of the bytes of the block leaves it. The
+ * lookups do not depend on each other and letters and vowels are counted without branches.
+ *
+ * @param data start of the block
+ * @param tokenState progress of the tokenizer
+ * @param counts counts where the words are stored
+ */
+static void run_stateless(const unsigned char *data, TokenState *tokenState, WordCounts *counts) {
+    int word_length = tokenState->word_length;
+    int num_vowels = tokenState->num_vowels;
+
+    for (int i = 0; i < SCALAR_BLOCK; i++) {
+        unsigned char flags = byte_masks[data[i]];
+
+        if ((flags & (1 << MASK_SPLIT)) && word_length > 0) {
+            tokenState->word_length = word_length;
+            tokenState->num_vowels = num_vowels;
+            add_word(tokenState, counts);
+            word_length = 0;
+            num_vowels = 0;
+        }
+        word_length += (flags >> MASK_LETTER) & 1;
+        num_vowels += (flags >> MASK_VOWEL) & 1;
+    }
+    tokenState->word_length = word_length;
+    tokenState->num_vowels = num_vowels;
+}
+
+/**
+ * \brief Check if a block of SCALAR_BLOCK bytes can be processed without the state machine.
+ *
+ * The words of the block are tested eight bytes at a time (SWAR): first for bytes with the high bit set, which pure
+ * ASCII blocks do not have, and then, when there are only a few bytes leaving the initial state, for those bytes.
+ *
+ * @param data start of the block
+ * @return 1 if none of the bytes of the block leaves the initial state, 0 otherwise.
+ */
+static inline int block_is_stateless(const unsigned char *data) {
+    uint64_t words[SCALAR_BLOCK / 8];
+    uint64_t high_bits = 0;
+
+    memcpy(words, data, SCALAR_BLOCK);
+    for (int w = 0; w < SCALAR_BLOCK / 8; w++)
+        high_bits |= words[w];
+
+    if (!(high_bits & SWAR_HIGHS))
+        return ascii_stateless;
+
+    if (num_escape_bytes > MAX_SWAR_ESCAPES)
+        return 0;
+
+    for (int w = 0; w < SCALAR_BLOCK / 8; w++) {
+        for (int e = 0; e < num_escape_bytes; e++) {
+            uint64_t x = words[w] ^ (SWAR_ONES * escape_bytes[e]);
+            if ((x - SWAR_ONES) & ~x & SWAR_HIGHS)
+                return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * \brief Scalar kernel, working on blocks of SCALAR_BLOCK bytes.
+ *
+ * Blocks without bytes that leave the initial state, namely the pure ASCII ones, are processed by the simpler
+ * stateless loop, and only the remaining blocks go through the full state machine.
+ */
+static void kernel_scalar(const unsigned char *data, int n, TokenState *tokenState, WordCounts *counts) {
+    int i = 0;
+
+    for (; i + SCALAR_BLOCK <= n; i += SCALAR_BLOCK) {
+        if (tokenState->state == 0 && block_is_stateless(data + i))
+            run_stateless(data + i, tokenState, counts);
+        else
+            run_state_machine(data + i, SCALAR_BLOCK, tokenState, counts);
+    }
+    run_state_machine(data + i, n - i, tokenState, counts);
+}
+
+#ifdef X86_KERNELS
+
+/**
+ * \brief Turn the masks of a vector block into words.
+ *
+ * Bit i of each mask refers to byte i of the block. The letters and vowels before each split position are added to
+ * the current word, which is then stored.
+ *
+ * @param split positions of the characters that split words
+ * @param letter positions of the characters that are part of words
+ * @param vowel positions of the vowels
+ * @param tokenState progress of the tokenizer
+ * @param counts counts where the words are stored
+ */
+__attribute__((target("popcnt,bmi")))
+static inline void add_block_words(uint64_t split, uint64_t letter, uint64_t vowel, TokenState *tokenState,
+                                   WordCounts *counts) {
+    while (split) {
+        uint64_t before = (split & -split) - 1;
+
+        tokenState->word_length += __builtin_popcountll(letter & before);
+        tokenState->num_vowels += __builtin_popcountll(vowel & before);
+        letter &= ~before;
+        vowel &= ~before;
+
+        if (tokenState->word_length > 0)
+            add_word(tokenState, counts);
+
+        split &= split - 1;
+    }
+    tokenState->word_length += __builtin_popcountll(letter);
+    tokenState->num_vowels += __builtin_popcountll(vowel);
+}
+
+/**
+ * \brief Kernel that classifies 16 bytes at a time with SSE4.2.
+ */
+__attribute__((target("sse4.2,popcnt,bmi")))
+static void kernel_sse42(const unsigned char *data, int n, TokenState *tokenState, WordCounts *counts) {
+    const __m128i low_mask = _mm_set1_epi8(0x0F);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bits = _mm_loadu_si128((const __m128i *) nibble_bits);
+    __m128i lut[NUM_MASKS][2];
+    unsigned int masks[NUM_MASKS];
+    int i = 0;
+
+    for (int m = 0; m < NUM_MASKS; m++) {
+        lut[m][0] = _mm_loadu_si128((const __m128i *) nibble_lut[m][0]);
+        lut[m][1] = _mm_loadu_si128((const __m128i *) nibble_lut[m][1]);
+    }
+
+    for (; i + 16 <= n; i += 16) {
+        if (tokenState->state == 0) {
+            __m128i block = _mm_loadu_si128((const __m128i *) (data + i));
+            __m128i low = _mm_and_si128(block, low_mask);
+            __m128i high = _mm_shuffle_epi8(bits, _mm_and_si128(_mm_srli_epi16(block, 4), low_mask));
+
+            for (int m = 0; m < NUM_MASKS; m++) {
+                __m128i row = _mm_blendv_epi8(_mm_shuffle_epi8(lut[m][0], low), _mm_shuffle_epi8(lut[m][1], low), block);
+                masks[m] = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(row, high), zero)) & 0xFFFF;
+            }
+
+            if (!masks[MASK_ESCAPE]) {
+                add_block_words(masks[MASK_SPLIT], masks[MASK_LETTER], masks[MASK_VOWEL], tokenState, counts);
+                continue;
+            }
+        }
+        run_state_machine(data + i, 16, tokenState, counts);
+    }
+    run_state_machine(data + i, n - i, tokenState, counts);
+}
+
+/**
+ * \brief Kernel that classifies 32 bytes at a time with AVX2.
+ */
+__attribute__((target("avx2,popcnt,bmi")))
+static void kernel_avx2(const unsigned char *data, int n, TokenState *tokenState, WordCounts *counts) {
+    const __m256i low_mask = _mm256_set1_epi8(0x0F);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i bits = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) nibble_bits));
+    __m256i lut[NUM_MASKS][2];
+    uint64_t masks[NUM_MASKS];
+    int i = 0;
+
+    for (int m = 0; m < NUM_MASKS; m++) {
+        lut[m][0] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) nibble_lut[m][0]));
+        lut[m][1] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) nibble_lut[m][1]));
+    }
+
+    for (; i + 32 <= n; i += 32) {
+        if (tokenState->state == 0) {
+            __m256i block = _mm256_loadu_si256((const __m256i *) (data + i));
+            __m256i low = _mm256_and_si256(block, low_mask);
+            __m256i high = _mm256_shuffle_epi8(bits, _mm256_and_si256(_mm256_srli_epi16(block, 4), low_mask));
+
+            for (int m = 0; m < NUM_MASKS; m++) {
+                __m256i row = _mm256_blendv_epi8(_mm256_shuffle_epi8(lut[m][0], low),
+                                                 _mm256_shuffle_epi8(lut[m][1], low), block);
+                masks[m] = ~(uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(row, high), zero));
+            }
+
+            if (!masks[MASK_ESCAPE]) {
+                add_block_words(masks[MASK_SPLIT], masks[MASK_LETTER], masks[MASK_VOWEL], tokenState, counts);
+                continue;
+            }
+        }
+        run_state_machine(data + i, 32, tokenState, counts);
+    }
+    run_state_machine(data + i, n - i, tokenState, counts);
+}
+
+/**
+ * \brief Kernel that classifies 64 bytes at a time with AVX-512.
+ */
+__attribute__((target("avx512f,avx512bw,popcnt,bmi")))
+static void kernel_avx512(const unsigned char *data, int n, TokenState *tokenState, WordCounts *counts) {
+    const __m512i low_mask = _mm512_set1_epi8(0x0F);
+    const __m512i bits = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *) nibble_bits));
+    __m512i lut[NUM_MASKS][2];
+    uint64_t masks[NUM_MASKS];
+    int i = 0;
+
+    for (int m = 0; m < NUM_MASKS; m++) {
+        lut[m][0] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *) nibble_lut[m][0]));
+        lut[m][1] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *) nibble_lut[m][1]));
+    }
+
+    for (; i + 64 <= n; i += 64) {
+        if (tokenState->state == 0) {
+            __m512i block = _mm512_loadu_si512((const void *) (data + i));
+            __m512i low = _mm512_and_si512(block, low_mask);
+            __m512i high = _mm512_shuffle_epi8(bits, _mm512_and_si512(_mm512_srli_epi16(block, 4), low_mask));
+            __mmask64 upper_half = _mm512_movepi8_mask(block);
+
+            for (int m = 0; m < NUM_MASKS; m++) {
+                __m512i row = _mm512_mask_blend_epi8(upper_half, _mm512_shuffle_epi8(lut[m][0], low),
+                                                     _mm512_shuffle_epi8(lut[m][1], low));
+                masks[m] = _mm512_test_epi8_mask(row, high);
+            }
+
+            if (!masks[MASK_ESCAPE]) {
+                add_block_words(masks[MASK_SPLIT], masks[MASK_LETTER], masks[MASK_VOWEL], tokenState, counts);
+                continue;
+            }
+        }
+        run_state_machine(data + i, 64, tokenState, counts);
+    }
+    run_state_machine(data + i, n - i, tokenState, counts);
+}
+
+#endif
+
+/**
+ * \brief Store the word in progress, if any, and go back to the initial state.
+ *
+ * A UTF-8 sequence still waiting for continuation bytes is dropped.
+ *
+ * @param tokenState progress of the tokenizer
+ * @param counts counts where the words are stored
+ */
+void flush_token_state(TokenState *tokenState, WordCounts *counts) {
+    if (tokenState->word_length > 0) {
+        if (text_metrics != 0 || vocabulary_selected || sketches_selected)
+            add_metric_word(tokenState, counts);
+        else
+            add_word(tokenState, counts);
+    }
+    tokenState->state = 0;
+}
+
+/**
+ * \brief Force the use of a kernel, given its name.
+ *
+ * @param name one of "scalar", "sse4.2", "avx2" or "avx512".
+ * @return 1 if the kernel exists and is supported by the CPU, 0 otherwise.
+ */
+int select_token_kernel(const char *name) {
+    if (strcmp(name, "scalar") == 0) {
+        token_kernel = kernel_scalar;
+        token_kernel_name = "scalar";
+        return 1;
+    }
+#ifdef X86_KERNELS
+    __builtin_cpu_init();
+    // the vector kernels are compiled with popcnt and bmi as well, which some CPUs with SSE4.2 lack
+    if (!__builtin_cpu_supports("popcnt") || !__builtin_cpu_supports("bmi"))
+        return 0;
+
+    if (strcmp(name, "avx512") == 0 && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+        token_kernel = kernel_avx512;
+        token_kernel_name = "avx512";
+        return 1;
+    }
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        token_kernel = kernel_avx2;
+        token_kernel_name = "avx2";
+        return 1;
+    }
+    if (strcmp(name, "sse4.2") == 0 && __builtin_cpu_supports("sse4.2")) {
+        token_kernel = kernel_sse42;
+        token_kernel_name = "sse4.2";
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+/**
+ * \brief Prepare the kernels for a transition table and select the best one supported by the CPU.
+ *
+ * Builds, from the initial state of the transition table, the nibble lookup tables used by the vector kernels.
+ *
+ * @param transitions transition table of the state machine, with the next state in the upper bits of each entry and
+ * the action in the lower two.
+ */
+void init_token_kernel(const unsigned char (*transitions)[NUM_BYTES]) {
+    kernel_transitions = transitions;
+    memset(nibble_lut, 0, sizeof nibble_lut);
+    memset(byte_masks, 0, sizeof byte_masks);
+    num_escape_bytes = 0;
+    ascii_stateless = 1;
+
+    for (int chr = 0; chr < NUM_BYTES; chr++) {
+        int action = transitions[0][chr] & 3;
+        int in_mask[NUM_MASKS];
+
+        in_mask[MASK_SPLIT] = action == ACTION_SPLIT;
+        in_mask[MASK_LETTER] = action == ACTION_LETTER || action == ACTION_VOWEL;
+        in_mask[MASK_VOWEL] = action == ACTION_VOWEL;
+        in_mask[MASK_ESCAPE] = (transitions[0][chr] >> 2) != 0;
+
+        if (in_mask[MASK_ESCAPE]) {
+            if (chr < 0x80)
+                ascii_stateless = 0;
+            if (num_escape_bytes < MAX_SWAR_ESCAPES)
+                escape_bytes[num_escape_bytes] = (unsigned char) chr;
+            num_escape_bytes++;
+        }
+
+        for (int m = 0; m < NUM_MASKS; m++) {
+            if (in_mask[m]) {
+                nibble_lut[m][chr >> 7][chr & 0x0F] |= nibble_bits[chr >> 4];
+                byte_masks[chr] |= 1 << m;
+            }
+        }
+    }
+
+    if (!select_token_kernel("avx512") && !select_token_kernel("avx2") && !select_token_kernel("sse4.2"))
+        select_token_kernel("scalar");
+}
@@ -0,0 +1,63 @@
+/**
+ *  \file tokenKernel.h (header file)
+ *
+ *  \brief Problem: Frequency of word lengths and the number of vowels
+ *
+ *  Tokenizer kernels header file
+ *
+ *  \author Rafael Direito - June 2020
+ */
+
+#include "controlInfo.h"
+
+#ifndef TOKENKERNEL_H_
+#define TOKENKERNEL_H_
+
+/** \brief number of bytes the transition table can be indexed by. */
+#define NUM_BYTES           256
+
+/** \brief largest number of states of a transition table, as each entry keeps the next state in six bits. */
+#define MAX_STATES          64
+
+/* Actions taken by the state machine for each byte */
+#define ACTION_NONE         0
+#define ACTION_LETTER       1
+#define ACTION_VOWEL        2
+#define ACTION_SPLIT        3
+
+/** \brief Progress of the tokenizer, kept between blocks and between buffers. */
+typedef struct {
+    int state;
+    int word_length;
+    int num_vowels;
+    int code_point;                 /* code point being decoded, used by the text metrics only */
+    int utf8_pending;               /* continuation bytes still expected by code_point */
+    int last_letter;                /* previous letter of the word in progress, 0 at its start */
+    int sentence_words;             /* number of words of the sentence in progress */
+    int word_text_length;           /* bytes of the text of the word in progress, up to its last letter */
+    int word_text_used;             /* bytes of word_text in use, with the joiners after the last letter */
+    char word_text[MAX_WORD_TEXT];  /* text of the word in progress, used by the vocabulary and the sketches only */
+} TokenState;
+
+/** \brief Signature shared by every tokenizer kernel. */
+typedef void (*TokenKernel)(const unsigned char *data, int n, TokenState *tokenState, WordCounts *counts);
+
+/** \brief Kernel selected for this CPU. */
+extern TokenKernel token_kernel;
+
+/** \brief Name of the kernel selected for this CPU. */
+extern const char *token_kernel_name;
+
+/** \brief Prepare the kernels for a transition table and select the best one supported by the CPU. */
+extern void init_token_kernel(const unsigned char (*transitions)[NUM_BYTES]);
+
+/** \brief Force the use of a kernel, given its name. */
+extern int select_token_kernel(const char *name);
+
+/** \brief Kernel that computes the selected text metrics, the vocabulary and the word sketches with the word counts. */
+extern void metrics_kernel(const unsigned char *data, int n, TokenState *tokenState, WordCounts *counts);
+
+/** \brief Store the word in progress, if any, and go back to the initial state. */
+extern void flush_token_state(TokenState *tokenState, WordCounts *counts);
+
+#endif
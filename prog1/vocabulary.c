@@ -0,0 +1,239 @@
+/**
+ *  \file vocabulary.c
+ *
+ *  \brief Problem: Frequency of word lengths and the number of vowels
+ *
+ *  Implements the vocabulary: the exact number of times each word was found. The words are the letters of a word,
+ *  folded to lower case, with the joiners between them, as UTF-8.
+ *
+ *  A vocabulary is an open addressing table of the hashes, texts and counts of its words. The texts are copied once,
+ *  when a word is first added, into large blocks of an arena, so a word costs a table entry and its bytes, without an
+ *  allocation of its own; the arena is freed a block at a time with the vocabulary.
+ *
+ *  \author Rafael Direito - June 2020
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "controlInfo.h"
+#include "vocabulary.h"
+
+/** \brief number of bytes of each block of the arena of the texts. */
+#define ARENA_BLOCK_SIZE    (1 << 20)
+
+/** \brief bytes at the start of each block of the arena, with the address of the previous block. */
+#define ARENA_LINK_SIZE     sizeof(char *)
+
+/** \brief If true, the text of the words is kept and their frequencies counted. */
+int vocabulary_selected = 0;
+
+/**
+ * \brief Hash of the text of a word, 64-bit FNV-1a.
+ *
+ * The lower bits place the word in the tables, and the upper ones choose the process that owns it.
+ *
+ * @param text text of the word
+ * @param length number of bytes of the text
+ * @return the hash.
+ */
+unsigned long long vocabulary_hash(const char *text, int length) {
+    unsigned long long hash = 0xCBF29CE484222325ULL;
+
+    for (int i = 0; i < length; i++)
+        hash = (hash ^ (unsigned char) text[i]) * 0x100000001B3ULL;
+
+    return hash;
+}
+
+/**
+ * \brief Find the entry of a word, or the free entry where it goes.
+ *
+ * @param vocabulary vocabulary with entries
+ * @param text text of the word
+ * @param length number of bytes of the text
+ * @param hash hash of the text
+ * @return the entry.
+ */
+static VocabularyEntry *find_word(const Vocabulary *vocabulary, const char *text, int length,
+                                  unsigned long long hash) {
+    unsigned int mask = vocabulary->size - 1;
+    unsigned int i = (unsigned int) hash & mask;
+    VocabularyEntry *entry;
+
+    while (true) {
+        entry = &vocabulary->entries[i];
+        if (entry->count == 0 || (entry->hash == hash && entry->length == length
+                                  && memcmp(entry->text, text, length) == 0))
+            return entry;
+        i = (i + 1) & mask;
+    }
+}
+
+/**
+ * \brief Double the size of the table of a vocabulary, keeping it at most half full.
+ *
+ * The texts stay where they are in the arena.
+ *
+ * @param vocabulary vocabulary
+ * @return 1 if the table grew, 0 otherwise.
+ */
+static int grow_vocabulary(Vocabulary *vocabulary) {
+    Vocabulary grown = *vocabulary;
+
+    grown.size = vocabulary->size > 0 ? 2 * vocabulary->size : 1024;
+    grown.entries = calloc(grown.size, sizeof(VocabularyEntry));
+    if (grown.entries == NULL)
+        return 0;
+
+    for (int i = 0; i < vocabulary->size; i++)
+        if (vocabulary->entries[i].count != 0)
+            *find_word(&grown, vocabulary->entries[i].text, vocabulary->entries[i].length,
+                       vocabulary->entries[i].hash) = vocabulary->entries[i];
+
+    free(vocabulary->entries);
+    vocabulary->entries = grown.entries;
+    vocabulary->size = grown.size;
+    return 1;
+}
+
+/**
+ * \brief Copy the text of a word into the arena of a vocabulary, starting a new block if it does not fit.
+ *
+ * @param vocabulary vocabulary
+ * @param text text of the word
+ * @param length number of bytes of the text, at most MAX_WORD_TEXT
+ * @return the copy, or NULL if there is no memory.
+ */
+static const char *store_text(Vocabulary *vocabulary, const char *text, int length) {
+    char *copy;
+
+    if (vocabulary->arena == NULL || vocabulary->arena_used + length > ARENA_BLOCK_SIZE) {
+        char *block = malloc(ARENA_BLOCK_SIZE);
+
+        if (block == NULL)
+            return NULL;
+        memcpy(block, &vocabulary->arena, ARENA_LINK_SIZE);
+        vocabulary->arena = block;
+        vocabulary->arena_used = ARENA_LINK_SIZE;
+    }
+
+    copy = vocabulary->arena + vocabulary->arena_used;
+    memcpy(copy, text, length);
+    vocabulary->arena_used += length;
+    return copy;
+}
+
+/**
+ * \brief Add to the count of a word.
+ *
+ * @param vocabulary vocabulary
+ * @param text text of the word, copied if the word is new
+ * @param length number of bytes of the text, at most MAX_WORD_TEXT
+ * @param hash hash of the text, given by vocabulary_hash
+ * @param count number to add
+ */
+void vocabulary_add(Vocabulary *vocabulary, const char *text, int length, unsigned long long hash,
+                    long long count) {
+    VocabularyEntry *entry;
+
+    if (2 * (vocabulary->num_entries + 1) > vocabulary->size && !grow_vocabulary(vocabulary)
+        && vocabulary->num_entries == vocabulary->size) {
+        fprintf(stderr, "ERROR: Unable to count the word %.*s\n", length, text);
+        return;
+    }
+
+    entry = find_word(vocabulary, text, length, hash);
+    if (entry->count == 0) {
+        entry->text = store_text(vocabulary, text, length);
+        if (entry->text == NULL) {
+            fprintf(stderr, "ERROR: Unable to count the word %.*s\n", length, text);
+            return;
+        }
+        entry->hash = hash;
+        entry->length = length;
+        vocabulary->num_entries++;
+    }
+    entry->count += count;
+}
+
+/**
+ * \brief Add the counts of a vocabulary to another one.
+ *
+ * @param vocabulary vocabulary to add to
+ * @param other vocabulary to add
+ */
+void vocabulary_merge(Vocabulary *vocabulary, const Vocabulary *other) {
+    for (int i = 0; i < other->size; i++)
+        if (other->entries[i].count != 0)
+            vocabulary_add(vocabulary, other->entries[i].text, other->entries[i].length, other->entries[i].hash,
+                           other->entries[i].count);
+}
+
+/**
+ * \brief Free a vocabulary, its table and every block of its arena, which is left empty.
+ *
+ * @param vocabulary vocabulary
+ */
+void vocabulary_free(Vocabulary *vocabulary) {
+    char *block = vocabulary->arena, *previous;
+
+    while (block != NULL) {
+        memcpy(&previous, block, ARENA_LINK_SIZE);
+        free(block);
+        block = previous;
+    }
+
+    free(vocabulary->entries);
+    memset(vocabulary, 0, sizeof *vocabulary);
+}
+
+/**
+ * \brief Order entries by their text, byte by byte, a text coming before the longer ones it starts.
+ */
+static int by_text(const void *a, const void *b) {
+    const VocabularyEntry *x = *(const VocabularyEntry * const *) a, *y = *(const VocabularyEntry * const *) b;
+    int shortest = x->length < y->length ? x->length : y->length;
+    int order = memcmp(x->text, y->text, shortest);
+
+    return order != 0 ? order : x->length - y->length;
+}
+
+/**
+ * \brief Write the words of a vocabulary and their counts, sorted by their text, one word per line.
+ *
+ * The text and the count of a word are separated by a tab. The control characters and the backslashes of the text,
+ * which only invalid UTF-8 makes letters of, are written as \xHH, so that each line holds a single word.
+ *
+ * @param vocabulary vocabulary
+ * @param file where the words are written
+ * @return 1 if the words were written, 0 otherwise.
+ */
+int vocabulary_write(const Vocabulary *vocabulary, FILE *file) {
+    const VocabularyEntry **sorted = malloc((vocabulary->num_entries + 1) * sizeof(VocabularyEntry *));
+    int n = 0;
+
+    if (sorted == NULL)
+        return 0;
+
+    for (int i = 0; i < vocabulary->size; i++)
+        if (vocabulary->entries[i].count != 0)
+            sorted[n++] = &vocabulary->entries[i];
+    qsort(sorted, n, sizeof(VocabularyEntry *), by_text);
+
+    for (int i = 0; i < n; i++) {
+        for (int k = 0; k < sorted[i]->length; k++) {
+            unsigned char chr = (unsigned char) sorted[i]->text[k];
+
+            if (chr < 0x20 || chr == 0x7F || chr == '\\')
+                fprintf(file, "\\x%02X", chr);
+            else
+                fputc(chr, file);
+        }
+        fprintf(file, "\t%lld\n", sorted[i]->count);
+    }
+
+    free(sorted);
+    return ferror(file) == 0;
+}
@@ -0,0 +1,36 @@
+/**
+ *  \file vocabulary.h (header file)
+ *
+ *  \brief Problem: Frequency of word lengths and the number of vowels
+ *
+ *  Vocabulary header file: exact frequency of every word
+ *
+ *  \author Rafael Direito - June 2020
+ */
+
+#include <stdio.h>
+#include "controlInfo.h"
+
+#ifndef VOCABULARY_H_
+#define VOCABULARY_H_
+
+/** \brief If true, the text of the words is kept and their frequencies counted. */
+extern int vocabulary_selected;
+
+/** \brief Hash of the text of a word. */
+extern unsigned long long vocabulary_hash(const char *text, int length);
+
+/** \brief Add to the count of a word. */
+extern void vocabulary_add(Vocabulary *vocabulary, const char *text, int length, unsigned long long hash,
+                           long long count);
+
+/** \brief Add the counts of a vocabulary to another one. */
+extern void vocabulary_merge(Vocabulary *vocabulary, const Vocabulary *other);
+
+/** \brief Free a vocabulary, which is left empty. */
+extern void vocabulary_free(Vocabulary *vocabulary);
+
+/** \brief Write the words of a vocabulary and their counts, sorted by their text. */
+extern int vocabulary_write(const Vocabulary *vocabulary, FILE *file);
+
+#endif
@@ -0,0 +1,304 @@
+/**
+ *  \file wordSketch.c
+ *
+ *  \brief Problem: Frequency of word lengths and the number of vowels
+ *
+ *  Implements the sketches of the words, which estimate in a fixed amount of memory, whatever the number of words,
+ *  how many distinct words there are and which words are the most frequent.
+ *
+ *  The distinct words are estimated by a HyperLogLog sketch: each word sets a register, chosen by the upper bits of its
+ *  hash, to the largest number of leading zeros plus one seen in the rest of the hash. The counts of the words are
+ *  estimated by a count-min sketch, rows of counters each indexed by a different hash of the word, whose smallest
+ *  counter never counts a word short. The most frequent words, by these counts, are kept in a min-heap, with more
+ *  candidates than are printed. Registers are merged by keeping the largest, counters by adding them, and the heaps by
+ *  estimating the words of both again from the merged counters, so the sketches of the chunks add up to the sketches
+ *  of the whole files.
+ *
+ *  \author Rafael Direito - June 2020
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "controlInfo.h"
+#include "wordSketch.h"
+
+/** \brief number of words printed on each line. */
+#define WORDS_PER_LINE      4
+
+/** \brief columns taken by the text of each word printed. */
+#define WORD_COLUMNS        16
+
+/** \brief If true, the sketches of the words are kept. */
+int sketches_selected = 0;
+
+/**
+ * \brief Mix the bits of the hash of a word, so that its upper bits are as good as the others.
+ *
+ * @param hash hash given by vocabulary_hash
+ * @return the mixed hash.
+ */
+static unsigned long long mix_hash(unsigned long long hash) {
+    hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+    return hash ^ (hash >> 31);
+}
+
+/**
+ * \brief Counter of a row of the count-min sketch that counts a word, from two halves of its hash.
+ *
+ * @param hash mixed hash of the word
+ * @param row row of the sketch
+ * @return the position of the counter in the row.
+ */
+static inline int counter_of(unsigned long long hash, int row) {
+    unsigned int first = (unsigned int) hash, second = (unsigned int) (hash >> 32) | 1;
+
+    return (int) ((first + (unsigned int) row * second) % SKETCH_WIDTH);
+}
+
+/**
+ * \brief Estimate the count of a word from the count-min sketch: its smallest counter.
+ *
+ * @param sketch sketches
+ * @param hash mixed hash of the word
+ * @return the estimated count, never smaller than the true one.
+ */
+static long long estimate_count(const WordSketch *sketch, unsigned long long hash) {
+    long long estimate = sketch->counters[0][counter_of(hash, 0)];
+
+    for (int row = 1; row < SKETCH_DEPTH; row++)
+        if (sketch->counters[row][counter_of(hash, row)] < estimate)
+            estimate = sketch->counters[row][counter_of(hash, row)];
+
+    return estimate;
+}
+
+/**
+ * \brief Move a word of the heap down, towards the more frequent words, until the heap is in order.
+ *
+ * @param sketch sketches
+ * @param i position of the word
+ */
+static void sift_down(WordSketch *sketch, int i) {
+    HeavyHitter moved = sketch->top[i];
+
+    while (2 * i + 1 < sketch->num_top) {
+        int child = 2 * i + 1;
+
+        if (child + 1 < sketch->num_top && sketch->top[child + 1].count < sketch->top[child].count)
+            child++;
+        if (moved.count <= sketch->top[child].count)
+            break;
+        sketch->top[i] = sketch->top[child];
+        i = child;
+    }
+    sketch->top[i] = moved;
+}
+
+/**
+ * \brief Move a word of the heap up, towards the least frequent words, until the heap is in order.
+ *
+ * @param sketch sketches
+ * @param i position of the word
+ */
+static void sift_up(WordSketch *sketch, int i) {
+    HeavyHitter moved = sketch->top[i];
+
+    while (i > 0 && sketch->top[(i - 1) / 2].count > moved.count) {
+        sketch->top[i] = sketch->top[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    sketch->top[i] = moved;
+}
+
+/**
+ * \brief Offer a word, with its estimated count, to the heap of the most frequent words.
+ *
+ * A word of the heap gets the new count. Another word takes the place of the least frequent one, if it is more
+ * frequent, or a free place while the heap is not full.
+ *
+ * @param sketch sketches
+ * @param text text of the word
+ * @param length number of bytes of the text
+ * @param hash mixed hash of the word
+ * @param count estimated count of the word
+ */
+static void offer_word(WordSketch *sketch, const char *text, int length, unsigned long long hash, long long count) {
+    HeavyHitter *word;
+
+    if (sketch->num_top == SKETCH_CANDIDATES && count <= sketch->top[0].count)
+        return;
+
+    for (int i = 0; i < sketch->num_top; i++) {
+        word = &sketch->top[i];
+        if (word->hash == hash && word->length == length && memcmp(word->text, text, length) == 0) {
+            word->count = count;
+            sift_down(sketch, i);
+            return;
+        }
+    }
+
+    word = &sketch->top[sketch->num_top < SKETCH_CANDIDATES ? sketch->num_top : 0];
+    word->hash = hash;
+    word->count = count;
+    word->length = length;
+    memcpy(word->text, text, length);
+
+    if (sketch->num_top < SKETCH_CANDIDATES)
+        sift_up(sketch, sketch->num_top++);
+    else
+        sift_down(sketch, 0);
+}
+
+/**
+ * \brief Create empty sketches.
+ *
+ * @return the sketches, or NULL if there is no memory.
+ */
+WordSketch *sketch_create() {
+    WordSketch *sketch = calloc(1, sizeof(WordSketch));
+
+    if (sketch == NULL)
+        fprintf(stderr, "ERROR: Unable to keep the sketches of the words\n");
+    return sketch;
+}
+
+/**
+ * \brief Add a word to the sketches.
+ *
+ * @param sketch sketches
+ * @param text text of the word
+ * @param length number of bytes of the text, at most MAX_WORD_TEXT
+ * @param hash hash of the text, given by vocabulary_hash
+ */
+void sketch_add(WordSketch *sketch, const char *text, int length, unsigned long long hash) {
+    unsigned long long rest;
+    int rank;
+
+    hash = mix_hash(hash);
+
+    // the leading zeros of the bits after the register, plus one
+    rest = hash << SKETCH_REGISTER_BITS;
+    rank = rest != 0 ? __builtin_clzll(rest) + 1 : 64 - SKETCH_REGISTER_BITS + 1;
+    if (rank > sketch->registers[hash >> (64 - SKETCH_REGISTER_BITS)])
+        sketch->registers[hash >> (64 - SKETCH_REGISTER_BITS)] = (unsigned char) rank;
+
+    for (int row = 0; row < SKETCH_DEPTH; row++)
+        sketch->counters[row][counter_of(hash, row)] += 1;
+
+    offer_word(sketch, text, length, hash, estimate_count(sketch, hash));
+}
+
+/**
+ * \brief Add the words of sketches to others.
+ *
+ * The most frequent words of both are estimated again from the merged counters, and the most frequent of them kept.
+ *
+ * @param sketch sketches to add to
+ * @param other sketches to add
+ */
+void sketch_merge(WordSketch *sketch, const WordSketch *other) {
+    HeavyHitter *candidates = malloc(2 * SKETCH_CANDIDATES * sizeof(HeavyHitter));
+    int numCandidates = 0;
+
+    for (int i = 0; i < SKETCH_REGISTERS; i++)
+        if (other->registers[i] > sketch->registers[i])
+            sketch->registers[i] = other->registers[i];
+
+    for (int row = 0; row < SKETCH_DEPTH; row++)
+        for (int i = 0; i < SKETCH_WIDTH; i++)
+            sketch->counters[row][i] += other->counters[row][i];
+
+    if (candidates == NULL) {
+        fprintf(stderr, "ERROR: Unable to merge the most frequent words\n");
+        return;
+    }
+
+    memcpy(candidates, sketch->top, sketch->num_top * sizeof(HeavyHitter));
+    memcpy(candidates + sketch->num_top, other->top, other->num_top * sizeof(HeavyHitter));
+    numCandidates = sketch->num_top + other->num_top;
+
+    sketch->num_top = 0;
+    for (int i = 0; i < numCandidates; i++)
+        offer_word(sketch, candidates[i].text, candidates[i].length, candidates[i].hash,
+                   estimate_count(sketch, candidates[i].hash));
+    free(candidates);
+}
+
+/**
+ * \brief Estimate the number of distinct words added to the sketches, from the registers of the HyperLogLog.
+ *
+ * The harmonic mean of the registers gives the estimate; while it is small and registers are still zero, the number
+ * of zero registers gives a better one.
+ *
+ * @param sketch sketches
+ * @return the estimate, within about 1.04 / sqrt(SKETCH_REGISTERS) of the true number.
+ */
+double sketch_distinct(const WordSketch *sketch) {
+    double m = SKETCH_REGISTERS, sum = 0.0, estimate;
+    int numZeros = 0;
+
+    for (int i = 0; i < SKETCH_REGISTERS; i++) {
+        sum += 1.0 / (double) (1ULL << sketch->registers[i]);
+        numZeros += sketch->registers[i] == 0;
+    }
+
+    estimate = 0.7213 / (1.0 + 1.079 / m) * m * m / sum;
+    if (estimate <= 2.5 * m && numZeros > 0)
+        estimate = m * log(m / numZeros);
+
+    return estimate;
+}
+
+/**
+ * \brief Order the most frequent words by decreasing count, and by text for the same count.
+ */
+static int by_count(const void *a, const void *b) {
+    const HeavyHitter *x = a, *y = b;
+    int shortest = x->length < y->length ? x->length : y->length;
+    int order;
+
+    if (x->count != y->count)
+        return x->count < y->count ? 1 : -1;
+    order = memcmp(x->text, y->text, shortest);
+    return order != 0 ? order : x->length - y->length;
+}
+
+/**
+ * \brief Print the estimated number of distinct words and the SKETCH_TOP_WORDS most frequent words, with their
+ * estimated counts.
+ *
+ * @param sketch sketches, or NULL if no word was added
+ */
+void sketch_print(const WordSketch *sketch) {
+    HeavyHitter sorted[SKETCH_CANDIDATES];
+    int numTop = sketch != NULL ? sketch->num_top : 0;
+
+    printf("Distinct words = %.0f (estimated, +/- %.1f%%);\n", sketch != NULL ? sketch_distinct(sketch) : 0.0,
+           104.0 / sqrt(SKETCH_REGISTERS));
+    if (numTop == 0) {
+        printf("\n");
+        return;
+    }
+
+    memcpy(sorted, sketch->top, numTop * sizeof(HeavyHitter));
+    qsort(sorted, numTop, sizeof(HeavyHitter), by_count);
+    if (numTop > SKETCH_TOP_WORDS)
+        numTop = SKETCH_TOP_WORDS;
+
+    printf("Most frequent words (estimated counts):\n");
+    for (int i = 0; i < numTop; i++) {
+        int columns = 0;
+
+        // each code point takes a column, whatever the length of its encoding
+        for (int k = 0; k < sorted[i].length; k++)
+            columns += ((unsigned char) sorted[i].text[k] & 0xC0) != 0x80;
+        printf("%*s%.*s%10lld", columns < WORD_COLUMNS ? WORD_COLUMNS - columns : 0, "", sorted[i].length,
+               sorted[i].text, sorted[i].count);
+        if ((i + 1) % WORDS_PER_LINE == 0 || i + 1 == numTop)
+            printf("\n");
+    }
+    printf("\n");
+}
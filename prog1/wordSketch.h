@@ -0,0 +1,57 @@
+/**
+ *  \file wordSketch.h (header file)
+ *
+ *  \brief Problem: Frequency of word lengths and the number of vowels
+ *
+ *  Word sketch header file: fixed size estimates of the number of distinct words and of the most frequent words
+ *
+ *  \author Rafael Direito - June 2020
+ */
+
+#include "controlInfo.h"
+
+#ifndef WORDSKETCH_H_
+#define WORDSKETCH_H_
+
+/** \brief number of registers of the HyperLogLog sketch. */
+#define SKETCH_REGISTERS    (1 << SKETCH_REGISTER_BITS)
+
+/** \brief One of the most frequent words, with its count estimated by the count-min sketch. */
+typedef struct {
+    unsigned long long hash;        /* mixed hash of the text */
+    long long count;                /* estimated count, 0 for an entry not in use */
+    int length;                     /* number of bytes of the text */
+    char text[MAX_WORD_TEXT];
+} HeavyHitter;
+
+/** \brief Sketches of the words: a HyperLogLog of the distinct words, a count-min sketch of the counts of the words
+ * and a min-heap of the most frequent ones. */
+typedef struct WordSketch {
+    unsigned char registers[SKETCH_REGISTERS];
+    long long counters[SKETCH_DEPTH][SKETCH_WIDTH];   /* summed over all the files, so 64-bit */
+    int num_top;                    /* number of words of the heap */
+    HeavyHitter top[SKETCH_CANDIDATES]; /* heap of the most frequent words, the least frequent first */
+} WordSketch;
+
+/** \brief number of ints of the sketches in the encoding of the counts, with their 64-bit counters. */
+#define SKETCH_ENCODED_SIZE ((int) ((sizeof(WordSketch) + sizeof(int) - 1) / sizeof(int)))
+
+/** \brief If true, the sketches of the words are kept. */
+extern int sketches_selected;
+
+/** \brief Create empty sketches. */
+extern WordSketch *sketch_create();
+
+/** \brief Add a word to the sketches. */
+extern void sketch_add(WordSketch *sketch, const char *text, int length, unsigned long long hash);
+
+/** \brief Add the words of sketches to others. */
+extern void sketch_merge(WordSketch *sketch, const WordSketch *other);
+
+/** \brief Estimate the number of distinct words added to the sketches. */
+extern double sketch_distinct(const WordSketch *sketch);
+
+/** \brief Print the estimated number of distinct words and the most frequent words. */
+extern void sketch_print(const WordSketch *sketch);
+
+#endif
@@ -0,0 +1,573 @@
+/**
+ *  \file wordstats.c
+ *
+ *  \brief Problem: Frequency of word lengths and the number of vowels
+ *
+ *  Implements libwordstats, the streaming word length and vowel counter used by the workers.
+ *
+ *  The characters are classified by a transition table, built from the built-in rules (init_classifier) or from a
+ *  language profile (load_classifier), and shared by every counter. A counter is started with wordstats_init, fed
+ *  any number of buffers with wordstats_feed and closed with wordstats_finish. Partial words and pending UTF-8
+ *  prefixes are carried from one buffer to the next, so the results do not depend on how the input is split.
+ *
+ *  \author Rafael Direito - June 2020
+ */
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "controlInfo.h"
+#include "tokenKernel.h"
+#include "langProfile.h"
+#include "wordstats.h"
+#include "textMetrics.h"
+#include "vocabulary.h"
+#include "wordSketch.h"
+
+/** \brief bytes which are vowels, on their own or after the 0xC3 prefix. */
+static const unsigned char vowel_bytes[] = {0x61, 0x65, 0x69, 0x6F, 0x75, 0xA0, 0xA1, 0xA2, 0xA3, 0xA8, 0xA9, 0xAA,
+                                            0xAC, 0xAD, 0xB2, 0xB3, 0xB4, 0xB5, 0xB9, 0xBA, 0x80, 0x81, 0x82, 0x83,
+                                            0x88, 0x89, 0x8A, 0x8C, 0x8D, 0x92, 0x93, 0x94, 0x95, 0x99, 0x9A, 0xBC};
+
+/** \brief bytes which are considered to split words. */
+static const unsigned char split_bytes[] = {0x20, 0x09, 0x0A, 0x2D, 0x22, 0x9C, 0x9D, 0x5B, 0x5D, 0x7B, 0x7D, 0x28,
+                                            0x29, 0x2E, 0x2C, 0x3A, 0x3B, 0x3F, 0x21, 0x93, 0xA6, 0xC2, 0xAB, 0xBB,
+                                            0x60, 0x94};
+
+/* Byte classes */
+#define CLASS_SPLIT         0x01    /* splits words */
+#define CLASS_VOWEL         0x02    /* vowel */
+#define CLASS_VOWEL_PREFIX  0x04    /* 0xC3, first byte of an accented letter */
+#define CLASS_QUOTE_PREFIX  0x08    /* 0xE2, first byte of a quotation mark */
+#define CLASS_APOSTROPHE    0x10    /* 0x27 and 0x98, never part of a word */
+#define CLASS_QUOTE_MARK    0x20    /* 0x99, only part of a word after 0xC3 */
+#define CLASS_QUOTE_CONT    0x40    /* 0x80, keeps a pending quotation mark */
+
+/* States of the UTF-8 state machine, one bit per pending prefix */
+#define STATE_VOWEL_PENDING 0x01
+#define STATE_QUOTE_PENDING 0x02
+#define LEGACY_NUM_STATES   4
+
+/** \brief class of every byte value, after conversion to lower case. */
+static unsigned char byte_class[NUM_BYTES];
+
+/** \brief transition table, each entry holds the next state in the upper bits and the action in the lower two. */
+unsigned char transitions[MAX_STATES][NUM_BYTES];
+
+/** \brief number of states of the transition table. */
+int num_states;
+
+/** \brief bytes after which the state machine is in the initial state, whatever the state before them. */
+static unsigned char resets_state[NUM_BYTES];
+
+/** \brief bytes that end the word in progress when read in the initial state, and stay in it. */
+static unsigned char ends_word[NUM_BYTES];
+
+/** \brief bytes that end the word in progress and the sentence in progress when read in the initial state. */
+static unsigned char ends_sentence[NUM_BYTES];
+
+/**
+ * \brief Build the byte class and transition tables of the built-in rules, and select the tokenizer kernel.
+ *
+ * This or load_classifier must be called once before any counter is fed.
+ */
+void init_classifier() {
+    memset(byte_class, 0, sizeof byte_class);
+
+    for (int i = 0; i < sizeof(vowel_bytes) / sizeof(vowel_bytes[0]); i++)
+        byte_class[vowel_bytes[i]] |= CLASS_VOWEL;
+
+    for (int i = 0; i < sizeof(split_bytes) / sizeof(split_bytes[0]); i++)
+        byte_class[split_bytes[i]] |= CLASS_SPLIT;
+
+    byte_class[0xC3] |= CLASS_VOWEL_PREFIX;
+    byte_class[0xE2] |= CLASS_QUOTE_PREFIX;
+    byte_class[0x27] |= CLASS_APOSTROPHE;
+    byte_class[0x98] |= CLASS_APOSTROPHE;
+    byte_class[0x99] |= CLASS_QUOTE_MARK;
+    byte_class[0x80] |= CLASS_QUOTE_CONT;
+
+    // Upper case letters behave as their lower case counterparts.
+    for (int chr = 'A'; chr <= 'Z'; chr++)
+        byte_class[chr] = byte_class[tolower(chr)];
+
+    num_states = LEGACY_NUM_STATES;
+    for (int state = 0; state < LEGACY_NUM_STATES; state++) {
+        for (int chr = 0; chr < NUM_BYTES; chr++) {
+            unsigned char cls = byte_class[chr];
+            int vowel_potential = state & STATE_VOWEL_PENDING;
+            int quotation_potential = state & STATE_QUOTE_PENDING;
+            int action = ACTION_NONE;
+
+            if (cls & CLASS_VOWEL_PREFIX)
+                vowel_potential = STATE_VOWEL_PENDING;
+            else if (cls & CLASS_QUOTE_PREFIX)
+                quotation_potential = STATE_QUOTE_PENDING;
+
+            if (!vowel_potential && !quotation_potential && (cls & CLASS_SPLIT)) {
+                action = ACTION_SPLIT;
+            } else if (!(cls & (CLASS_VOWEL_PREFIX | CLASS_QUOTE_PREFIX))) {
+                if (!quotation_potential && !(cls & CLASS_APOSTROPHE) && (vowel_potential || !(cls & CLASS_QUOTE_MARK)))
+                    action = (cls & CLASS_VOWEL) ? ACTION_VOWEL : ACTION_LETTER;
+                if (!(cls & CLASS_QUOTE_CONT))
+                    quotation_potential = 0;
+                vowel_potential = 0;
+            }
+
+            transitions[state][chr] = (unsigned char) (((vowel_potential | quotation_potential) << 2) | action);
+        }
+    }
+
+    start_classifier();
+}
+
+/**
+ * \brief Build the transition table from a language profile, and select the tokenizer kernel.
+ *
+ * @param profileName name of the file with the language profile.
+ * @return 1 if the profile was loaded, 0 otherwise.
+ */
+int load_classifier(const char *profileName) {
+    int profile_states = compile_language_profile(profileName, transitions);
+
+    if (profile_states < 0)
+        return 0;
+
+    num_states = profile_states;
+    start_classifier();
+    return 1;
+}
+
+/**
+ * \brief Prepare the tokenizer kernels and the boundary tables for the transition table in transitions.
+ *
+ * Called by init_classifier and load_classifier, and by the processes that receive the table from another one.
+ */
+void start_classifier() {
+    for (int chr = 0; chr < NUM_BYTES; chr++) {
+        resets_state[chr] = 1;
+        for (int state = 0; state < num_states; state++)
+            if ((transitions[state][chr] >> 2) != 0)
+                resets_state[chr] = 0;
+
+        ends_word[chr] = transitions[0][chr] == ACTION_SPLIT;
+        ends_sentence[chr] = ends_word[chr] && (chr == '.' || chr == '!' || chr == '?');
+    }
+
+    init_token_kernel((const unsigned char (*)[NUM_BYTES]) transitions);
+}
+
+/**
+ * \brief Check if a given character is a vowel, according to the built-in rules.
+ *
+ * @param chr byte read from the file.
+ * @return 1 if the character it's a vowel, 0 otherwise.
+ */
+int check_vowel(unsigned char chr) {
+    return (byte_class[chr] & CLASS_VOWEL) != 0;
+}
+
+/**
+ * \brief Check if a given character is one of the characters which are considered to split words, according to the
+ * built-in rules.
+ *
+ * @param chr byte read from the file.
+ * @return 1 if the character it's a split character, 0 otherwise.
+ */
+int is_split_char(unsigned char chr) {
+    return (byte_class[chr] & CLASS_SPLIT) != 0;
+}
+
+/**
+ * \brief Start a counter, with no words and no pending characters.
+ *
+ * @param wordStats counter to start
+ */
+void wordstats_init(WordStats *wordStats) {
+    memset(wordStats, 0, sizeof *wordStats);
+}
+
+/**
+ * \brief Drop the word in progress and any pending prefix, keeping the counts, as if a new input started.
+ *
+ * @param wordStats counter
+ */
+void wordstats_restart(WordStats *wordStats) {
+    memset(&wordStats->tokenState, 0, sizeof wordStats->tokenState);
+}
+
+/**
+ * \brief Count the words of a buffer, and compute the selected text metrics, the vocabulary and the sketches of the
+ * words in the same pass.
+ *
+ * The word in progress at the end of the buffer, and any pending UTF-8 prefix, continue in the next buffer fed.
+ *
+ * @param wordStats counter
+ * @param buffer bytes to process
+ * @param length number of bytes to process
+ */
+void wordstats_feed(WordStats *wordStats, const unsigned char *buffer, size_t length) {
+    while (length > 0) {
+        int n = length > INT_MAX ? INT_MAX : (int) length;
+
+        if (text_metrics != 0 || vocabulary_selected || sketches_selected)
+            metrics_kernel(buffer, n, &wordStats->tokenState, &wordStats->counts);
+        else
+            token_kernel(buffer, n, &wordStats->tokenState, &wordStats->counts);
+        buffer += n;
+        length -= n;
+    }
+}
+
+/**
+ * \brief Find the first word boundary of a buffer that does not depend on the bytes before the buffer.
+ *
+ * The boundary follows a pair of bytes where the first one resets the state machine and the second one ends a word:
+ * the words before it are complete, and the next word starts right after it, whatever was read before. Counting the
+ * input piecewise, between the boundaries found by this function, gives the same counts as counting it at once.
+ *
+ * While the lengths of the sentences are computed, only the boundaries where a sentence ends are taken, so that the
+ * sentences are not cut either.
+ *
+ * @param buffer bytes to search
+ * @param length number of bytes of the buffer
+ * @return offset of the boundary, after the pair of bytes, or 0 if there is none in the buffer.
+ */
+size_t wordstats_next_boundary(const unsigned char *buffer, size_t length) {
+    const unsigned char *ends = (text_metrics & METRIC_BIT(METRIC_SENTENCES)) ? ends_sentence : ends_word;
+
+    for (size_t i = 1; i < length; i++)
+        if (ends[buffer[i]] && resets_state[buffer[i - 1]])
+            return i + 1;
+    return 0;
+}
+
+/**
+ * \brief Find the last boundary of a buffer, after a pair of bytes where the first resets the state machine and the
+ * second is one of the given bytes.
+ *
+ * @param buffer bytes to search
+ * @param length number of bytes of the buffer
+ * @param ends bytes that may close the boundary
+ * @return offset of the boundary, after the pair of bytes, or 0 if there is none in the buffer.
+ */
+static size_t last_boundary(const unsigned char *buffer, size_t length, const unsigned char *ends) {
+    for (size_t i = length; i > 1; i--)
+        if (ends[buffer[i - 1]] && resets_state[buffer[i - 2]])
+            return i;
+    return 0;
+}
+
+/**
+ * \brief Find the last word boundary of a buffer that does not depend on the bytes before the buffer.
+ *
+ * Same boundaries as wordstats_next_boundary, searched from the end of the buffer. While the lengths of the sentences
+ * are computed and no sentence ends in the buffer, a boundary where only a word ends is taken instead: the sentence
+ * longer than the buffer is cut there.
+ *
+ * @param buffer bytes to search
+ * @param length number of bytes of the buffer
+ * @return offset of the boundary, after the pair of bytes, or 0 if there is none in the buffer.
+ */
+size_t wordstats_last_boundary(const unsigned char *buffer, size_t length) {
+    size_t found;
+
+    if (text_metrics & METRIC_BIT(METRIC_SENTENCES)) {
+        found = last_boundary(buffer, length, ends_sentence);
+        if (found != 0)
+            return found;
+    }
+    return last_boundary(buffer, length, ends_word);
+}
+
+/**
+ * \brief Close a counter, storing the word in progress at the end of the input, if any.
+ *
+ * The counter can be fed again afterwards, as if a new input started.
+ *
+ * @param wordStats counter
+ * @return the counts of all the words fed to the counter.
+ */
+const WordCounts *wordstats_finish(WordStats *wordStats) {
+    flush_token_state(&wordStats->tokenState, &wordStats->counts);
+    return &wordStats->counts;
+}
+
+/**
+ * \brief Add word counts to others: the numbers of words and the histograms are summed, the largest values kept.
+ *
+ * Counts added to partial ones, of a file that could not be read whole, stay partial.
+ *
+ * @param counts counts to add to
+ * @param other counts to add
+ */
+void wordstats_merge(WordCounts *counts, const WordCounts *other) {
+    counts->num_words_read += other->num_words_read;
+    counts->read_failed |= other->read_failed;
+
+    if (other->max_num_vowels > counts->max_num_vowels)
+        counts->max_num_vowels = other->max_num_vowels;
+
+    if (other->max_word_length > counts->max_word_length)
+        counts->max_word_length = other->max_word_length;
+
+    for (int i = 0; i < WORD_LENGTH; i++)
+        counts->word_lengths[i] += other->word_lengths[i];
+
+    for (int i = 0; i <= WORD_LENGTH; i++)
+        for (int j = 0; j < WORD_LENGTH; j++)
+            counts->word_vowels[i][j] += other->word_vowels[i][j];
+
+    for (int i = 0; i < other->long_words_size; i++)
+        if (other->long_words[i].count != 0)
+            wordstats_add_long_words(counts, other->long_words[i].word_length, other->long_words[i].num_vowels,
+                                     other->long_words[i].count);
+
+    for (int metric = 0; metric < NUM_METRICS; metric++)
+        metric_table_merge(&counts->metrics[metric], &other->metrics[metric]);
+    vocabulary_merge(&counts->vocabulary, &other->vocabulary);
+
+    if (other->sketch != NULL && counts->sketch == NULL)
+        counts->sketch = sketch_create();
+    if (other->sketch != NULL && counts->sketch != NULL)
+        sketch_merge(counts->sketch, other->sketch);
+}
+
+/**
+ * \brief Find the entry of the long words of a length and number of vowels, or the free entry where it goes.
+ *
+ * @param counts counts with a table of long words
+ * @param length length of the words
+ * @param numVowels number of vowels of the words
+ * @return the entry.
+ */
+static LongWordCount *find_long_words(const WordCounts *counts, int length, int numVowels) {
+    unsigned int mask = counts->long_words_size - 1;
+    unsigned int i = ((unsigned int) length * 2654435761u + (unsigned int) numVowels) & mask;
+
+    while (counts->long_words[i].count != 0
+           && (counts->long_words[i].word_length != length || counts->long_words[i].num_vowels != numVowels))
+        i = (i + 1) & mask;
+
+    return &counts->long_words[i];
+}
+
+/**
+ * \brief Double the size of the table of long words, keeping it at most half full.
+ *
+ * @param counts counts
+ * @return 1 if the table grew, 0 otherwise.
+ */
+static int grow_long_words(WordCounts *counts) {
+    WordCounts grown = *counts;
+
+    grown.long_words_size = counts->long_words_size > 0 ? 2 * counts->long_words_size : 16;
+    grown.long_words = calloc(grown.long_words_size, sizeof(LongWordCount));
+    if (grown.long_words == NULL)
+        return 0;
+
+    for (int i = 0; i < counts->long_words_size; i++)
+        if (counts->long_words[i].count != 0)
+            *find_long_words(&grown, counts->long_words[i].word_length, counts->long_words[i].num_vowels) =
+                    counts->long_words[i];
+
+    free(counts->long_words);
+    counts->long_words = grown.long_words;
+    counts->long_words_size = grown.long_words_size;
+    return 1;
+}
+
+/**
+ * \brief Add words longer than WORD_LENGTH to the counts, in the table of long words.
+ *
+ * Only the histograms are updated: the number of words and the largest values are kept by the caller.
+ *
+ * @param counts counts
+ * @param length length of the words
+ * @param numVowels number of vowels of the words
+ * @param count number of words
+ */
+void wordstats_add_long_words(WordCounts *counts, int length, int numVowels, int count) {
+    LongWordCount *entry;
+
+    if (2 * (counts->num_long_words + 1) > counts->long_words_size && !grow_long_words(counts)
+        && counts->num_long_words == counts->long_words_size) {
+        fprintf(stderr, "ERROR: Unable to count the words of length %d\n", length);
+        return;
+    }
+
+    entry = find_long_words(counts, length, numVowels);
+    if (entry->count == 0) {
+        entry->word_length = length;
+        entry->num_vowels = numVowels;
+        counts->num_long_words++;
+    }
+    entry->count += count;
+}
+
+/**
+ * \brief Free the table of long words, the accumulators of the metrics, the vocabulary and the sketches of some
+ * counts, which are left empty of them.
+ *
+ * @param counts counts
+ */
+void wordstats_free_counts(WordCounts *counts) {
+    free(counts->long_words);
+    counts->long_words = NULL;
+    counts->num_long_words = 0;
+    counts->long_words_size = 0;
+
+    for (int metric = 0; metric < NUM_METRICS; metric++)
+        metric_table_free(&counts->metrics[metric]);
+    vocabulary_free(&counts->vocabulary);
+    free(counts->sketch);
+    counts->sketch = NULL;
+}
+
+/**
+ * \brief Get the number of words of a length with a number of vowels.
+ *
+ * @param counts counts
+ * @param numVowels number of vowels
+ * @param length length of the words, from 1
+ * @return the number of words.
+ */
+int wordstats_vowel_count(const WordCounts *counts, int numVowels, int length) {
+    if (length <= WORD_LENGTH)
+        return numVowels <= WORD_LENGTH ? counts->word_vowels[numVowels][length - 1] : 0;
+    if (counts->long_words_size == 0)
+        return 0;
+    return find_long_words(counts, length, numVowels)->count;
+}
+
+/**
+ * \brief Get the number of words of each length.
+ *
+ * @param counts counts
+ * @param lengths where the number of words of length i + 1 is stored at position i
+ * @param maxLength number of lengths
+ */
+void wordstats_length_counts(const WordCounts *counts, int *lengths, int maxLength) {
+    for (int i = 0; i < maxLength; i++)
+        lengths[i] = i < WORD_LENGTH ? counts->word_lengths[i] : 0;
+
+    for (int i = 0; i < counts->long_words_size; i++)
+        if (counts->long_words[i].count != 0 && counts->long_words[i].word_length <= maxLength)
+            lengths[counts->long_words[i].word_length - 1] += counts->long_words[i].count;
+}
+
+/**
+ * \brief Number of ints of the sparse encoding of some counts.
+ *
+ * @param counts counts
+ * @return the number of ints written by wordstats_encode.
+ */
+int wordstats_encoded_size(const WordCounts *counts) {
+    int numEntries = counts->num_long_words;
+    int metricsSize = 0;
+
+    for (int i = 0; i <= WORD_LENGTH; i++)
+        for (int j = 0; j < WORD_LENGTH; j++)
+            numEntries += counts->word_vowels[i][j] != 0;
+
+    for (int metric = 0; metric < NUM_METRICS; metric++)
+        metricsSize += metric_table_encoded_size(&counts->metrics[metric]);
+
+    return 4 + 3 * numEntries + metricsSize + 1 + (counts->sketch != NULL ? SKETCH_ENCODED_SIZE : 0) + 1;
+}
+
+/**
+ * \brief Encode some counts sparsely: only the histogram entries that are not zero are kept.
+ *
+ * The encoding is the number of words, the largest number of vowels, the largest length and the number of entries,
+ * followed by the length, number of vowels and number of words of each entry. The histogram of the lengths is the sum
+ * of the entries of each length, and is not encoded. The accumulators of the metrics follow, in order, and then
+ * whether there are sketches of the words, followed by them, as they are in memory: they have a fixed size. The flag
+ * of partial counts comes last. The vocabulary is not encoded: it is exchanged between the processes by itself.
+ *
+ * @param counts counts
+ * @param buffer where the encoding is written, with room for wordstats_encoded_size ints
+ * @return the number of ints written.
+ */
+int wordstats_encode(const WordCounts *counts, int *buffer) {
+    int size = 4;
+
+    buffer[0] = counts->num_words_read;
+    buffer[1] = counts->max_num_vowels;
+    buffer[2] = counts->max_word_length;
+
+    for (int i = 0; i <= WORD_LENGTH; i++)
+        for (int j = 0; j < WORD_LENGTH; j++)
+            if (counts->word_vowels[i][j] != 0) {
+                buffer[size++] = j + 1;
+                buffer[size++] = i;
+                buffer[size++] = counts->word_vowels[i][j];
+            }
+
+    for (int i = 0; i < counts->long_words_size; i++)
+        if (counts->long_words[i].count != 0) {
+            buffer[size++] = counts->long_words[i].word_length;
+            buffer[size++] = counts->long_words[i].num_vowels;
+            buffer[size++] = counts->long_words[i].count;
+        }
+
+    buffer[3] = (size - 4) / 3;
+
+    for (int metric = 0; metric < NUM_METRICS; metric++)
+        size += metric_table_encode(&counts->metrics[metric], buffer + size);
+
+    buffer[size++] = counts->sketch != NULL;
+    if (counts->sketch != NULL) {
+        memcpy(buffer + size, counts->sketch, sizeof(WordSketch));
+        size += SKETCH_ENCODED_SIZE;
+    }
+    buffer[size++] = counts->read_failed;
+    return size;
+}
+
+/**
+ * \brief Add counts encoded by wordstats_encode to others.
+ *
+ * @param counts counts to add to
+ * @param buffer encoded counts to add
+ * @return the number of ints read.
+ */
+int wordstats_decode(WordCounts *counts, const int *buffer) {
+    const int *entry = buffer + 4;
+    int size;
+
+    counts->num_words_read += buffer[0];
+    if (buffer[1] > counts->max_num_vowels)
+        counts->max_num_vowels = buffer[1];
+    if (buffer[2] > counts->max_word_length)
+        counts->max_word_length = buffer[2];
+
+    for (int i = 0; i < buffer[3]; i++, entry += 3) {
+        if (entry[0] <= WORD_LENGTH) {
+            counts->word_lengths[entry[0] - 1] += entry[2];
+            counts->word_vowels[entry[1]][entry[0] - 1] += entry[2];
+        } else
+            wordstats_add_long_words(counts, entry[0], entry[1], entry[2]);
+    }
+
+    size = 4 + 3 * buffer[3];
+    for (int metric = 0; metric < NUM_METRICS; metric++)
+        size += metric_table_decode(&counts->metrics[metric], buffer + size);
+
+    if (buffer[size++]) {
+        WordSketch *other = sketch_create();
+
+        if (counts->sketch == NULL)
+            counts->sketch = sketch_create();
+        if (other != NULL && counts->sketch != NULL) {
+            memcpy(other, buffer + size, sizeof(WordSketch));
+            sketch_merge(counts->sketch, other);
+        }
+        free(other);
+        size += SKETCH_ENCODED_SIZE;
+    }
+    counts->read_failed |= buffer[size++];
+    return size;
+}
@@ -0,0 +1,87 @@
+/**
+ *  \file wordstats.h (header file)
+ *
+ *  \brief Problem: Frequency of word lengths and the number of vowels
+ *
+ *  libwordstats header file: streaming word length and vowel counter
+ *
+ *  \author Rafael Direito - June 2020
+ */
+
+#include <stddef.h>
+#include "controlInfo.h"
+#include "tokenKernel.h"
+
+#ifndef WORDSTATS_H_
+#define WORDSTATS_H_
+
+/** \brief Streaming counter: the progress of the tokenizer and the counts of the words found so far. */
+typedef struct {
+    TokenState tokenState;
+    WordCounts counts;
+} WordStats;
+
+/** \brief Transition table used to classify the characters. */
+extern unsigned char transitions[MAX_STATES][NUM_BYTES];
+
+/** \brief Number of states of the transition table. */
+extern int num_states;
+
+/** \brief Build the tables used to classify the characters, with the built-in rules. */
+extern void init_classifier();
+
+/** \brief Build the tables used to classify the characters from a language profile. */
+extern int load_classifier(const char *profileName);
+
+/** \brief Prepare the tokenizer kernels and the boundary tables for the transition table. */
+extern void start_classifier();
+
+/** \brief Check if a given character is a vowel, according to the built-in rules. */
+extern int check_vowel(unsigned char chr);
+
+/** \brief Check if a given character is one of the characters which are considered to split words, by the built-in rules. */
+extern int is_split_char(unsigned char chr);
+
+/** \brief Start a counter, with no words and no pending characters. */
+extern void wordstats_init(WordStats *wordStats);
+
+/** \brief Drop the word in progress and any pending prefix, keeping the counts, as if a new input started. */
+extern void wordstats_restart(WordStats *wordStats);
+
+/** \brief Count the words of a buffer, carrying the word in progress and pending prefixes to the next one. */
+extern void wordstats_feed(WordStats *wordStats, const unsigned char *buffer, size_t length);
+
+/** \brief Find the first word boundary of a buffer that does not depend on the bytes before the buffer. */
+extern size_t wordstats_next_boundary(const unsigned char *buffer, size_t length);
+
+/** \brief Find the last word boundary of a buffer that does not depend on the bytes before the buffer. */
+extern size_t wordstats_last_boundary(const unsigned char *buffer, size_t length);
+
+/** \brief Close a counter, storing the word in progress at the end of the input, if any. */
+extern const WordCounts *wordstats_finish(WordStats *wordStats);
+
+/** \brief Add word counts to others. */
+extern void wordstats_merge(WordCounts *counts, const WordCounts *other);
+
+/** \brief Add words longer than WORD_LENGTH to the counts, in the table of long words. */
+extern void wordstats_add_long_words(WordCounts *counts, int length, int numVowels, int count);
+
+/** \brief Free the table of long words, the accumulators of the metrics and the vocabulary of some counts. */
+extern void wordstats_free_counts(WordCounts *counts);
+
+/** \brief Get the number of words of a length with a number of vowels. */
+extern int wordstats_vowel_count(const WordCounts *counts, int numVowels, int length);
+
+/** \brief Get the number of words of each length. */
+extern void wordstats_length_counts(const WordCounts *counts, int *lengths, int maxLength);
+
+/** \brief Number of ints of the sparse encoding of some counts. */
+extern int wordstats_encoded_size(const WordCounts *counts);
+
+/** \brief Encode some counts sparsely. */
+extern int wordstats_encode(const WordCounts *counts, int *buffer);
+
+/** \brief Add counts encoded by wordstats_encode to others. */
+extern int wordstats_decode(WordCounts *counts, const int *buffer);
+
+#endif
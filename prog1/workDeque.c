@@ -0,0 +1,100 @@
+/**
+ *  \file workDeque.c
+ *
+ *  \brief Problem name: Frequency of word lengths and the number of vowels.
+ *
+ *  Implements the deques of chunks of the threads of prog1-threads. Each thread takes the chunks of its own deque from
+ *  the bottom, the newest first, and steals from the top of the deques of the others once its own is empty. The work
+ *  per chunk is large, so a lock per deque costs little next to it.
+ *
+ *  \author Rafael Direito - June 2020
+ */
+
+#include <stdlib.h>
+#include "workDeque.h"
+
+/**
+ * \brief Create an empty deque.
+ *
+ * @param deque deque to create
+ * @param capacity number of chunks the deque can hold
+ * @return 1 if the deque was created, 0 otherwise.
+ */
+int deque_init(WorkDeque *deque, int capacity) {
+    deque->entries = malloc(capacity * sizeof(RingEntry *));
+    if (deque->entries == NULL)
+        return 0;
+
+    pthread_mutex_init(&deque->lock, NULL);
+    deque->capacity = capacity;
+    deque->top = 0;
+    deque->count = 0;
+    return 1;
+}
+
+/**
+ * \brief Free a deque.
+ *
+ * @param deque deque to free
+ */
+void deque_destroy(WorkDeque *deque) {
+    pthread_mutex_destroy(&deque->lock);
+    free(deque->entries);
+}
+
+/**
+ * \brief Add a chunk at the bottom of a deque.
+ *
+ * @param deque deque
+ * @param entry chunk
+ * @return 1 if the chunk was added, 0 if the deque is full.
+ */
+int deque_push(WorkDeque *deque, RingEntry *entry) {
+    int added = 0;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count < deque->capacity) {
+        deque->entries[(deque->top + deque->count++) % deque->capacity] = entry;
+        added = 1;
+    }
+    pthread_mutex_unlock(&deque->lock);
+
+    return added;
+}
+
+/**
+ * \brief Take the newest chunk of a deque, by its thread.
+ *
+ * @param deque deque
+ * @return the chunk, or NULL if the deque is empty.
+ */
+RingEntry *deque_pop(WorkDeque *deque) {
+    RingEntry *entry = NULL;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count > 0)
+        entry = deque->entries[(deque->top + --deque->count) % deque->capacity];
+    pthread_mutex_unlock(&deque->lock);
+
+    return entry;
+}
+
+/**
+ * \brief Take the oldest chunk of a deque, by another thread.
+ *
+ * @param deque deque
+ * @return the chunk, or NULL if the deque is empty.
+ */
+RingEntry *deque_steal(WorkDeque *deque) {
+    RingEntry *entry = NULL;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count > 0) {
+        entry = deque->entries[deque->top];
+        deque->top = (deque->top + 1) % deque->capacity;
+        deque->count--;
+    }
+    pthread_mutex_unlock(&deque->lock);
+
+    return entry;
+}
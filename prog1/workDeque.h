@@ -0,0 +1,41 @@
+/**
+ *  \file workDeque.h (header file)
+ *
+ *  \brief Problem name: Frequency of word lengths and the number of vowels.
+ *
+ *  Work deque header file: chunks waiting for a thread, which other threads may steal
+ *
+ *  \author Rafael Direito - June 2020
+ */
+
+#include <pthread.h>
+#include "chunkRing.h"
+
+#ifndef WORKDEQUE_H_
+#define WORKDEQUE_H_
+
+/** \brief Chunks waiting for a thread: taken by the thread from the bottom, and stolen by the others from the top. */
+typedef struct {
+    pthread_mutex_t lock;
+    RingEntry **entries;            /* ring of the chunks, oldest first, starting at top */
+    int capacity;                   /* number of chunks the deque can hold */
+    int top;                        /* position of the oldest chunk */
+    int count;                      /* number of chunks */
+} WorkDeque;
+
+/** \brief Create an empty deque. */
+extern int deque_init(WorkDeque *deque, int capacity);
+
+/** \brief Free a deque. */
+extern void deque_destroy(WorkDeque *deque);
+
+/** \brief Add a chunk at the bottom of a deque. */
+extern int deque_push(WorkDeque *deque, RingEntry *entry);
+
+/** \brief Take the newest chunk of a deque, by its thread. */
+extern RingEntry *deque_pop(WorkDeque *deque);
+
+/** \brief Take the oldest chunk of a deque, by another thread. */
+extern RingEntry *deque_steal(WorkDeque *deque);
+
+#endif
@@ -17,105 +17,327 @@
 #include <libgen.h>
 #include "probConst.h"
 #include "controlInfo.h"
+#include "wordstats.h"
+#include "rangeReader.h"
 #include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+/** \brief number of bytes read at a time past the end of a byte range, while looking for its boundary. */
+#define BOUNDARY_READ_SIZE  4096
+
+/** \brief number of threads counting the chunks of the worker, including the calling one. */
+static int num_threads = 1;
+
+/** \brief threads started by the worker, besides the calling one. */
+static pthread_t *threads;
+
+/** \brief private counts of each thread, for the chunk being counted. */
+static WordStats *thread_stats;
+
+/** \brief barriers where the threads wait for a chunk, and for each other once it is counted. */
+static pthread_barrier_t job_start, job_end;
+
+/** \brief chunk being counted by the threads. */
+static const unsigned char *job_buffer;
+
+/** \brief number of bytes of the chunk being counted by the threads. */
+static size_t job_length;
+
+/** \brief number of sub-chunks of the chunk being counted by the threads. */
+static size_t job_num_sub_chunks;
+
+/** \brief next sub-chunk to be taken by a thread. */
+static atomic_size_t job_next;
+
+/** \brief flag that tells the threads to leave. */
+static int job_stop = 0;
+
+/** \brief buffer where the byte ranges are read. */
+static unsigned char *range_buffer = NULL;
+
+/** \brief size of the buffer where the byte ranges are read. */
+static size_t range_buffer_size = 0;
 
 /**
- * \brief Check if a given character, in hexadecimal, is a vowel.
+ * \brief Offset where a sub-chunk of the chunk being counted starts.
  *
- * @param character_hex pointer that contains the code that define the character in hexadecimal.
- * @return 1 if the character it's a vowel, 0 otherwise.
+ * Sub-chunks are cut every SUB_CHUNK_SIZE bytes, moved to the first boundary found by wordstats_next_boundary from
+ * the byte before the cut, as byte ranges are: they count the same words as the whole chunk, whatever the number of
+ * threads.
+ *
+ * @param k index of the sub-chunk, up to job_num_sub_chunks for the end of the chunk
+ * @return offset of the start of the sub-chunk in the chunk.
  */
-int check_vowel(const char* character_hex) {
-    char *vowels_hex[] = {"61", "65", "69", "6f", "75", "a0", "a1", "a2", "a3", "a8", "a9", "aa", "ac", "ad", "b2",
-                          "b3", "b4", "b5", "b9", "ba", "80", "81", "82", "83", "88", "89", "8a", "8c", "8d", "92",
-                          "93", "94", "95", "99", "9a", "bc"};
+static size_t sub_chunk_start(size_t k) {
+    size_t offset = k * SUB_CHUNK_SIZE;
+    size_t found;
 
-    for (int i = 0; i < sizeof(vowels_hex) / sizeof(vowels_hex[0]); i++)
-        if (strcmp(character_hex, vowels_hex[i]) == 0)
-            return 1;
+    if (k == 0)
+        return 0;
+    if (offset >= job_length)
+        return job_length;
 
-    return 0;
+    found = wordstats_next_boundary(job_buffer + offset - 1, job_length - offset + 1);
+    return found != 0 ? offset - 1 + found : job_length;
 }
 
 /**
- * \brief Check if a given character, in hexadecimal, is one of the characters which are considered to split words.
+ * \brief Count the sub-chunks of the chunk being counted, taking them one at a time until there are none left.
  *
- * @param character_hex pointer that contains the code that define the character in hexadecimal.
- * @return 1 if the character it's a split character, 0 otherwise.
+ * @param wordStats private counter of the calling thread
  */
-int is_split_char(const char* character_hex) {
-    char *split_tokens_hex[] = {"20", "9", "a", "2d", "22", "9c", "9d", "5b", "5d", "7b", "7d", "28", "29", "2e", "2c",
-                                "3a", "3b", "3f", "21", "93", "a6", "c2", "ab", "bb", "60", "94"};
+static void count_sub_chunks(WordStats *wordStats) {
+    size_t k;
 
-    for (int i = 0; i < sizeof(split_tokens_hex) / sizeof(split_tokens_hex[0]); i++)
-        if (strcmp(character_hex, split_tokens_hex[i]) == 0)
-            return 1;
+    while ((k = atomic_fetch_add(&job_next, 1)) < job_num_sub_chunks) {
+        size_t start = sub_chunk_start(k);
+        size_t stop = sub_chunk_start(k + 1);
 
-    return 0;
+        wordstats_restart(wordStats);
+        wordstats_feed(wordStats, job_buffer + start, stop - start);
+    }
 }
 
 /**
- * \brief Process the K tokens retrieved from the current open file.
+ * \brief Life cycle of the threads of the worker: count the sub-chunks of each chunk, until told to leave.
  *
- * Construct words with the caracters of the tokens, count every vowel found in them, as well as their lengths.
+ * @param arg private counter of the thread
+ * @return NULL
+ */
+static void *count_thread(void *arg) {
+    while (true) {
+        pthread_barrier_wait(&job_start);
+        if (job_stop)
+            return NULL;
+
+        count_sub_chunks((WordStats *) arg);
+        pthread_barrier_wait(&job_end);
+    }
+}
+
+/**
+ * \brief Start the threads that count the chunks of the worker along with the calling thread.
  *
- * @param controlInfo contains all the info needed to compute the results expected from a worker
+ * @param numThreads number of threads, including the calling one
+ * @return 1 if the threads were started, 0 otherwise, in which case the chunks are counted by the calling thread.
  */
-void process_data(ControlInfo *controlInfo) {
-    char hex[2];
-    unsigned char chr;
-    int vowel_potential = 0;
-    int quotation_potential = 0;
-    int word_length = 0;
-    int num_vowels = 0;
-
-    // Start variables
-    controlInfo->max_word_length = 0;
-    controlInfo->max_num_vowels = 0;
-    controlInfo->num_words_read = 0;
-
-    for (int i = 0; i < controlInfo->n_chars_read; i++) {
-        // Get the next character in the file.
-        chr = controlInfo->chars_read[i];
-        // Converts the character to hexadecimal.
-        sprintf(hex, "%x", tolower(chr));
-
-        // If the hexadecimal of the character is c3, then it can be a vowel.
-        if (strcmp(hex, "c3") == 0)
-            vowel_potential = 1;
-            // If the hexadecimal of the character is e2, then it can be single quotation marks, which merges words.
-        else if (strcmp(hex, "e2") == 0)
-            quotation_potential = 1;
-
-        // If the hexadecimal isn't a vowel or a single quotation mark, and is one of the characters that splits
-        // words, then we have a new word.
-        if (!vowel_potential && !quotation_potential && is_split_char(hex)) {
-            if (word_length > 0) {
-                if (word_length > controlInfo->max_word_length)
-                    controlInfo->max_word_length = word_length;
-
-                if (num_vowels > controlInfo->max_num_vowels)
-                    controlInfo->max_num_vowels = num_vowels;
-
-                controlInfo->word_lengths[word_length - 1] += 1;
-                controlInfo->word_vowels[num_vowels][word_length - 1] += 1;
-                controlInfo->num_words_read +=1 ;
-
-                num_vowels = 0;
-                word_length = 0;
-            }
-        } else {
-            if (strcmp(hex, "c3") != 0 && strcmp(hex, "e2") != 0) {
-                if (!quotation_potential && strcmp(hex, "27") != 0 && strcmp(hex, "98") != 0) {
-                    if ((vowel_potential && strcmp(hex, "99") == 0) || strcmp(hex, "99") != 0) {
-                        word_length += 1;
-                        num_vowels += check_vowel(hex);
-                    }
-                }
-                if (strcmp(hex, "80") != 0)
-                    quotation_potential = 0;
-                vowel_potential = 0;
+int start_worker_threads(int numThreads) {
+    if (numThreads <= 1)
+        return 1;
+
+    threads = malloc((numThreads - 1) * sizeof(pthread_t));
+    thread_stats = malloc(numThreads * sizeof(WordStats));
+    if (threads == NULL || thread_stats == NULL)
+        return 0;
+
+    for (int t = 0; t < numThreads; t++)
+        wordstats_init(&thread_stats[t]);
+
+    pthread_barrier_init(&job_start, NULL, numThreads);
+    pthread_barrier_init(&job_end, NULL, numThreads);
+
+    for (int t = 1; t < numThreads; t++) {
+        if (pthread_create(&threads[t - 1], NULL, count_thread, &thread_stats[t]) != 0) {
+            fprintf(stderr, "ERROR: Unable to start the threads of the worker\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    num_threads = numThreads;
+    return 1;
+}
+
+/**
+ * \brief Stop the threads started by start_worker_threads.
+ */
+void stop_worker_threads() {
+    if (num_threads <= 1)
+        return;
+
+    job_stop = 1;
+    pthread_barrier_wait(&job_start);
+    for (int t = 1; t < num_threads; t++)
+        pthread_join(threads[t - 1], NULL);
+
+    pthread_barrier_destroy(&job_start);
+    pthread_barrier_destroy(&job_end);
+    free(threads);
+    free(thread_stats);
+    num_threads = 1;
+}
+
+/**
+ * \brief Count the words of a chunk, starting at the initial state, and add them to a counter.
+ *
+ * Chunks larger than a sub-chunk are shared by the threads of the worker, which count into private counters that are
+ * merged into the counter once the whole chunk is counted.
+ *
+ * @param buffer chunk
+ * @param length number of bytes of the chunk
+ * @param wordStats counter
+ */
+static void count_chunk(const unsigned char *buffer, size_t length, WordStats *wordStats) {
+    if (num_threads <= 1 || length <= SUB_CHUNK_SIZE) {
+        wordstats_restart(wordStats);
+        wordstats_feed(wordStats, buffer, length);
+        return;
+    }
+
+    job_buffer = buffer;
+    job_length = length;
+    job_num_sub_chunks = (length + SUB_CHUNK_SIZE - 1) / SUB_CHUNK_SIZE;
+    atomic_store(&job_next, 0);
+
+    pthread_barrier_wait(&job_start);
+    count_sub_chunks(&thread_stats[0]);
+    pthread_barrier_wait(&job_end);
+
+    for (int t = 0; t < num_threads; t++) {
+        wordstats_merge(&wordStats->counts, &thread_stats[t].counts);
+        wordstats_free_counts(&thread_stats[t].counts);
+        wordstats_init(&thread_stats[t]);
+    }
+}
+
+/**
+ * \brief Process a chunk retrieved from the current open file.
+ *
+ * Construct words with the caracters of the chunk, count every vowel found in them, as well as their lengths, and
+ * add them to the counts of the file. Each chunk is counted on its own by libwordstats, and the word in progress at
+ * the end of the chunk is not stored: chunks end at word boundaries, except for words longer than a chunk, which are
+ * cut.
+ *
+ * @param controlInfo contains the chunk
+ * @param wordStats counter of the file of the chunk
+ */
+void process_data(ControlInfo *controlInfo, WordStats *wordStats) {
+    count_chunk(controlInfo->chars_read, controlInfo->n_chars_read, wordStats);
+}
+
+/**
+ * \brief Process a batch of small files, adding the words of each file to the counts of the file.
+ *
+ * The batch starts with its table, the number of files and a BatchPart for each, followed by the files themselves,
+ * each one whole and counted on its own.
+ *
+ * @param controlInfo contains the batch
+ * @param fileStats counters of all the files
+ */
+void process_batch(ControlInfo *controlInfo, WordStats *fileStats) {
+    const unsigned char *data;
+    BatchPart part;
+    int numParts;
+
+    memcpy(&numParts, controlInfo->chars_read, sizeof(int));
+    data = controlInfo->chars_read + BATCH_TABLE_SIZE(numParts);
+
+    for (int i = 0; i < numParts; i++) {
+        memcpy(&part, controlInfo->chars_read + BATCH_TABLE_SIZE(i), sizeof(BatchPart));
+        count_chunk(data, part.length, &fileStats[part.fileIndex]);
+        data += part.length;
+    }
+}
+
+/**
+ * \brief Make room for a given number of bytes in the buffer of the byte ranges.
+ *
+ * @param size number of bytes needed
+ * @return 1 if the buffer is large enough, 0 if it could not grow.
+ */
+static int reserve_range_buffer(size_t size) {
+    unsigned char *buffer;
+
+    if (size <= range_buffer_size)
+        return 1;
+
+    if (size < 2 * range_buffer_size)
+        size = 2 * range_buffer_size;
+
+    buffer = realloc(range_buffer, size);
+    if (buffer == NULL) {
+        fprintf(stderr, "ERROR: Unable to allocate %zu bytes for the byte range\n", size);
+        return 0;
+    }
+    range_buffer = buffer;
+    range_buffer_size = size;
+    return 1;
+}
+
+/**
+ * \brief Read a byte range of a file and add its words to the counts of the file.
+ *
+ * The byte range only gives the rough position of the work: the words counted are those between the first boundary
+ * found by wordstats_next_boundary from the byte before the range and the first one found from its last byte on, or
+ * the end of the file. As the boundaries do not depend on the bytes before them, the range before ends exactly where
+ * this one starts, and each word straddling the edges of the ranges is counted once, by the range where it starts.
+ * The byte before the range is read as well, and the range is extended until its closing boundary is found.
+ *
+ * If the file cannot be read, the range counts no words, and the counts of the file are marked as partial, so that
+ * the dispatcher leaves them out.
+ *
+ * @param controlInfo contains the byte range (fileIndex, offset and n_chars_read)
+ * @param wordStats counter of the file of the range
+ */
+void process_range(ControlInfo *controlInfo, WordStats *wordStats) {
+    // the byte before the range belongs to the boundary at its start
+    long first = controlInfo->offset > 0 ? controlInfo->offset - 1 : 0;
+    size_t length = controlInfo->offset + controlInfo->n_chars_read - first;
+    size_t num_read, search_from, start, stop;
+    long n;
+
+    if (!reserve_range_buffer(length + BOUNDARY_READ_SIZE)) {
+        wordStats->counts.read_failed = 1;
+        return;
+    }
+
+    n = read_range(controlInfo->fileIndex, first, range_buffer, length);
+    if (n < 0) {
+        wordStats->counts.read_failed = 1;
+        return;
+    }
+    num_read = n;
+
+    /* look for the boundary closing the range, from its last byte on, reading past the range until it is found. */
+    search_from = length - 1;
+    while (true) {
+        if (search_from < num_read) {
+            stop = wordstats_next_boundary(range_buffer + search_from, num_read - search_from);
+            if (stop != 0) {
+                stop += search_from;
+                break;
             }
         }
+
+        // at the end of the file, the range closes with it
+        if (num_read < length) {
+            stop = num_read;
+            break;
+        }
+
+        if (!reserve_range_buffer(length + BOUNDARY_READ_SIZE)) {
+            wordStats->counts.read_failed = 1;
+            return;
+        }
+        n = read_range(controlInfo->fileIndex, first + length, range_buffer + length, BOUNDARY_READ_SIZE);
+        if (n < 0) {
+            wordStats->counts.read_failed = 1;
+            return;
+        }
+
+        // the last byte already searched may start the boundary
+        search_from = num_read - 1;
+        num_read += n;
+        length += BOUNDARY_READ_SIZE;
+    }
+
+    /* the first range of a file starts with the file, the others at their first boundary. */
+    start = 0;
+    if (controlInfo->offset > 0) {
+        start = wordstats_next_boundary(range_buffer, stop);
+        if (start == 0)
+            start = stop;
     }
-}
\ No newline at end of file
+
+    count_chunk(range_buffer + start, stop - start, wordStats);
+}
@@ -10,17 +10,24 @@
 
 #include <stdbool.h>
 #include "controlInfo.h"
+#include "wordstats.h"
 
 #ifndef WORKER
 #define WORKER
 
-/** \brief Check if a given character, in hexadecimal, is a vowel. */
-extern int check_vowel(const char* character_hex);
+/** \brief Start the threads that count the chunks of the worker along with the calling thread. */
+extern int start_worker_threads(int numThreads);
 
-/** \brief Check if a given character, in hexadecimal, is one of the characters which are considered to split words. */
-extern int is_split_char(const char* character_hex);
+/** \brief Stop the threads that count the chunks of the worker. */
+extern void stop_worker_threads();
 
-/** \brief Process the K tokens retrieved from the current open file. */
-extern void process_data(ControlInfo *controlInfo);
+/** \brief Process a chunk retrieved from the current open file, adding its words to the counts of the file. */
+extern void process_data(ControlInfo *controlInfo, WordStats *wordStats);
+
+/** \brief Process a batch of small files, adding the words of each file to the counts of the file. */
+extern void process_batch(ControlInfo *controlInfo, WordStats *fileStats);
+
+/** \brief Read a byte range of a file and add its words to the counts of the file. */
+extern void process_range(ControlInfo *controlInfo, WordStats *wordStats);
 
 #endif